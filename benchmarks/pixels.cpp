@@ -0,0 +1,105 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// pixels::convert against a plain per-pixel loop doing the same conversion,
+// on a 4K buffer. Prints the mean of a few runs and checks both agree.
+
+#include "util/pixels.hpp"
+
+#include <fmt/format.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using pixels::Layout;
+
+constexpr size_t pixel_count = static_cast<size_t>(3840) * 2160;
+constexpr int runs = 20;
+
+using pixels_t = std::vector<unsigned char>;
+
+auto mean_ms(const std::function<void()> &func) -> double
+{
+    func();
+    const auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < runs; ++run) {
+        func();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+}
+
+// what a straightforward implementation does, one pixel at a time
+void reference(const pixels_t &src, Layout from, pixels_t &dst, Layout to, bool premultiply)
+{
+    const int in_channels = pixels::channels(from);
+    const int out_channels = pixels::channels(to);
+    const bool swap = (from == Layout::bgr || from == Layout::bgra) != (to == Layout::bgr || to == Layout::bgra);
+    for (size_t idx = 0; idx < pixel_count; ++idx) {
+        const auto *in = &src[idx * in_channels];
+        auto *out = &dst[idx * out_channels];
+        const unsigned alpha = in_channels == 4 ? in[3] : 255;
+        unsigned first = in[0];
+        unsigned second = in[1];
+        unsigned third = in[2];
+        if (premultiply) {
+            first = first * alpha / 255;
+            second = second * alpha / 255;
+            third = third * alpha / 255;
+        }
+        if (swap) {
+            std::swap(first, third);
+        }
+        out[0] = static_cast<unsigned char>(first);
+        out[1] = static_cast<unsigned char>(second);
+        out[2] = static_cast<unsigned char>(third);
+        if (out_channels == 4) {
+            out[3] = static_cast<unsigned char>(alpha);
+        }
+    }
+}
+
+auto bench(std::string_view name, Layout from, Layout to, bool premultiply) -> bool
+{
+    pixels_t src(pixel_count * pixels::channels(from));
+    std::mt19937 rng{1};
+    for (auto &byte : src) {
+        byte = static_cast<unsigned char>(rng());
+    }
+    pixels_t expected(pixel_count * pixels::channels(to));
+    pixels_t result(expected.size());
+
+    const auto reference_ms = mean_ms([&] { reference(src, from, expected, to, premultiply); });
+    const auto convert_ms =
+        mean_ms([&] { pixels::convert(src.data(), from, result.data(), to, pixel_count, premultiply); });
+    const bool same = expected == result;
+    fmt::print("{:<28} per pixel {:>7.1f}ms  pixels::convert {:>7.1f}ms  {:.1f}x{}\n", name, reference_ms, convert_ms,
+               reference_ms / convert_ms, same ? "" : "  MISMATCH");
+    return same;
+}
+
+auto main() -> int
+{
+    bool same = bench("premultiply + BGRA->RGBA", Layout::bgra, Layout::rgba, true);
+    same = bench("RGB->BGRA", Layout::rgb, Layout::bgra, false) && same;
+    same = bench("premultiply + BGRA->RGB", Layout::bgra, Layout::rgb, true) && same;
+    same = bench("BGR->RGB", Layout::bgr, Layout::rgb, false) && same;
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
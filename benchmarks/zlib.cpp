@@ -0,0 +1,148 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+// Bytes on the wire and upload latency of inline kitty images, raw and
+// compressed with zlib::compress. Runs on synthetic 4K RGBA images, or on a
+// raw RGBA dump given as: zlib_bench <file> <width> <height> [MB/s]
+// Latency is the compression time plus the wire bytes over the given link
+// speed (10MB/s by default, a typical ssh session).
+
+#include "util/zlib.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+constexpr int width_4k = 3840;
+constexpr int height_4k = 2160;
+constexpr int channels = 4;
+// what kitty.cpp sends per chunk: 3072 bytes of data and an escape around them
+constexpr size_t chunk_size = 3072;
+constexpr size_t chunk_overhead = 9;
+// mirrors Kitty::compress
+constexpr size_t sample_size = 256 * 1024;
+constexpr double max_ratio = 0.8;
+constexpr double bytes_per_mb = 1000.0 * 1000.0;
+
+using pixels_t = std::vector<unsigned char>;
+
+auto wire_bytes(size_t size) -> size_t
+{
+    const auto chunks = std::max<size_t>((size + chunk_size - 1) / chunk_size, 1);
+    return (4 * ((size + 2) / 3)) + (chunks * chunk_overhead);
+}
+
+// large flat areas and some text-like detail, like a screenshot
+auto make_ui() -> pixels_t
+{
+    pixels_t result(static_cast<size_t>(width_4k) * height_4k * channels);
+    std::mt19937 rng{1};
+    for (int row = 0; row < height_4k; ++row) {
+        for (int col = 0; col < width_4k; ++col) {
+            auto *pixel = &result.at(((static_cast<size_t>(row) * width_4k) + col) * channels);
+            const bool panel = (col / 960 + row / 540) % 2 == 0;
+            const bool text = row % 24 < 12 && col % 16 < 9 && (rng() % 4) == 0;
+            const unsigned char shade = text ? 20 : (panel ? 240 : 200);
+            pixel[0] = shade;
+            pixel[1] = shade;
+            pixel[2] = panel ? 250 : shade;
+            pixel[3] = 255;
+        }
+    }
+    return result;
+}
+
+// smooth gradients with sensor-like noise
+auto make_photo() -> pixels_t
+{
+    pixels_t result(static_cast<size_t>(width_4k) * height_4k * channels);
+    std::mt19937 rng{2};
+    std::normal_distribution<double> noise{0.0, 6.0};
+    for (int row = 0; row < height_4k; ++row) {
+        for (int col = 0; col < width_4k; ++col) {
+            auto *pixel = &result.at(((static_cast<size_t>(row) * width_4k) + col) * channels);
+            const double base = 255.0 * (col + row) / (width_4k + height_4k);
+            for (int channel = 0; channel < 3; ++channel) {
+                pixel[channel] = static_cast<unsigned char>(std::clamp(base + (channel * 20) + noise(rng), 0.0, 255.0));
+            }
+            pixel[3] = 255;
+        }
+    }
+    return result;
+}
+
+auto make_noise() -> pixels_t
+{
+    pixels_t result(static_cast<size_t>(width_4k) * height_4k * channels);
+    std::mt19937 rng{3};
+    for (auto &byte : result) {
+        byte = static_cast<unsigned char>(rng());
+    }
+    return result;
+}
+
+void run(const std::string &name, const pixels_t &pixels, double link_mbps)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const auto sample = std::min(pixels.size(), sample_size);
+    const auto sampled = zlib::compress(pixels.data() + ((pixels.size() - sample) / 2), sample).size();
+    std::vector<unsigned char> compressed;
+    if (static_cast<double>(sampled) <= static_cast<double>(sample) * max_ratio) {
+        compressed = zlib::compress(pixels.data(), pixels.size());
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const bool used = !compressed.empty() && static_cast<double>(compressed.size()) <=
+                                                 static_cast<double>(pixels.size()) * max_ratio;
+
+    const auto raw_wire = wire_bytes(pixels.size());
+    const auto sent_wire = used ? wire_bytes(compressed.size()) : raw_wire;
+    const double raw_latency = static_cast<double>(raw_wire) / (link_mbps * bytes_per_mb);
+    const double sent_latency = elapsed + (static_cast<double>(sent_wire) / (link_mbps * bytes_per_mb));
+    fmt::print("{:<8} {:>8.2f}MB -> {:>8.2f}MB {:>8.0f}ms compressing {:>6.2f}s -> {:>6.2f}s {}\n", name,
+               raw_wire / bytes_per_mb, sent_wire / bytes_per_mb, elapsed * 1000, raw_latency, sent_latency,
+               used ? "" : "(sent raw)");
+}
+
+auto main(int argc, char *argv[]) -> int
+{
+    double link_mbps = 10.0;
+    fmt::print("{:<8} {:>24} {:>21} {:>17}\n", "image", "wire bytes, raw -> sent", "compress", "latency");
+    if (argc >= 4) {
+        const std::string path = argv[1];
+        const auto size = static_cast<size_t>(std::stoi(argv[2])) * std::stoi(argv[3]) * channels;
+        if (argc >= 5) {
+            link_mbps = std::stod(argv[4]);
+        }
+        pixels_t pixels(size);
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs.read(reinterpret_cast<char *>(pixels.data()), static_cast<std::streamsize>(size))) {
+            fmt::print(stderr, "could not read {} bytes from {}\n", size, path);
+            return EXIT_FAILURE;
+        }
+        run("file", pixels, link_mbps);
+        return EXIT_SUCCESS;
+    }
+    run("ui", make_ui(), link_mbps);
+    run("photo", make_photo(), link_mbps);
+    run("noise", make_noise(), link_mbps);
+    return EXIT_SUCCESS;
+}
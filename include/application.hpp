@@ -18,6 +18,7 @@
 #define APPLICATION_H
 
 #include "canvas.hpp"
+#include "decoder.hpp"
 #include "flags.hpp"
 #include "os.hpp"
 #include "terminal.hpp"
@@ -25,6 +26,7 @@
 
 #include <atomic>
 #include <cstdlib>
+#include <mutex>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -46,21 +48,27 @@ class Application
 
     static void print_version();
     static void print_header();
+    static void handle_cache_command();
 
   private:
     std::unique_ptr<Terminal> terminal;
     std::unique_ptr<Canvas> canvas;
+    std::unique_ptr<Decoder> decoder;
+    std::mutex canvas_mutex;
 
     std::shared_ptr<Flags> flags;
     std::shared_ptr<spdlog::logger> logger;
 
     cn_unique_ptr<std::FILE, std::fclose> f_stderr;
     std::thread socket_thread;
+    std::thread cache_thread;
 
     void setup_logger();
     void set_silent();
     void socket_loop();
+    void cache_loop();
     void daemonize();
+    void add_image(const std::string &identifier, uint64_t generation, std::unique_ptr<Image> image);
 };
 
 #endif
@@ -0,0 +1,88 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DECODER_H
+#define DECODER_H
+
+#include "image.hpp"
+#include "terminal.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+// Loads images on a pool of worker threads. Every identifier has a single
+// pending slot, a newer add replaces the queued one and gives the identifier
+// a new generation so results of jobs already in flight can be discarded.
+// Generations come from one counter, so an identifier that is removed and
+// added again never reuses one.
+// Prefetch jobs only warm the resize cache, they run when no add is pending
+// and a new batch cancels whatever is left of the previous one.
+class Decoder
+{
+  public:
+    using callback_t = std::function<void(const std::string &, uint64_t, std::unique_ptr<Image>)>;
+
+    Decoder(const Terminal *terminal, callback_t callback);
+    ~Decoder();
+
+    void submit(const std::string &identifier, nlohmann::json command);
+    void cancel(const std::string &identifier);
+    void prefetch(std::vector<nlohmann::json> commands);
+    [[nodiscard]] auto is_latest(const std::string &identifier, uint64_t generation) -> bool;
+
+  private:
+    struct Job {
+        nlohmann::json command;
+        uint64_t generation = 0;
+    };
+
+    const Terminal *terminal;
+    callback_t callback;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<std::string> queue;
+    std::unordered_map<std::string, Job> pending;
+    std::unordered_map<std::string, uint64_t> generations;
+    uint64_t last_generation = 0;
+
+    std::deque<nlohmann::json> prefetch_queue;
+    unsigned active_prefetches = 0;
+    unsigned max_prefetches = 1;
+
+    std::vector<std::thread> workers;
+    std::atomic<bool> stop{false};
+
+    std::shared_ptr<spdlog::logger> logger;
+
+    void worker_loop();
+    void run_prefetch(const nlohmann::json &command);
+    [[nodiscard]] auto can_prefetch() const -> bool;
+};
+
+#endif
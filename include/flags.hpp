@@ -48,6 +48,17 @@ class Flags
     bool origin_center = false;
     int32_t scale_factor = 1;
     bool needs_scaling = false;
+    int32_t frame_cache_size = 64;
+    int32_t animation_cache_size = 128;
+    int32_t payload_cache_size = 32;
+    bool payload_cache_disk = false;
+    int32_t cache_max_size = 512;
+    int32_t cache_max_age = 30;
+    std::string cache_format = "image";
+    // kitty transmission mediums the terminal answered a query for, only
+    // probed when escape codes are used
+    bool kitty_shm = false;
+    bool kitty_file = false;
 
     std::string cmd_id;
     std::string cmd_action;
@@ -58,6 +69,9 @@ class Flags
     std::string cmd_max_height;
     std::string cmd_file_path;
 
+    bool cache_stats = false;
+    bool cache_prune = false;
+
   private:
     Flags();
     std::filesystem::path config_file;
@@ -21,14 +21,17 @@
 #include <memory>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <vector>
 
 #include "dimensions.hpp"
 #include "terminal.hpp"
+#include "util/damage.hpp"
 
 class Image
 {
   public:
     static auto load(const nlohmann::json &command, const Terminal *terminal) -> std::unique_ptr<Image>;
+    static void prefetch(const nlohmann::json &command, const Terminal *terminal);
     static auto check_cache(const Dimensions &dimensions, const std::filesystem::path &orig_path) -> std::string;
     static auto get_dimensions(const nlohmann::json &json, const Terminal *terminal) -> std::shared_ptr<Dimensions>;
 
@@ -40,15 +43,36 @@ class Image
     [[nodiscard]] virtual auto size() const -> size_t = 0;
     [[nodiscard]] virtual auto data() const -> const unsigned char * = 0;
     [[nodiscard]] virtual auto channels() const -> int = 0;
+    // copies the pixels into a buffer of size() bytes, images that convert
+    // their pixels lazily write the converted result straight into it
+    virtual void write_to(unsigned char *dst) const;
+    // areas that changed since the previous frame
+    [[nodiscard]] virtual auto damage() const -> std::vector<damage::Rect>;
 
     [[nodiscard]] virtual auto frame_delay() const -> int { return -1; }
     [[nodiscard]] virtual auto is_animated() const -> bool { return false; }
+    // position of the current frame in a loop that repeats the same pixels,
+    // -1 if frames never come back
+    [[nodiscard]] virtual auto frame_index() const -> int { return is_animated() ? -1 : 0; }
     [[nodiscard]] virtual auto filename() const -> std::string = 0;
     virtual auto next_frame() -> void {}
+    // a file that decodes to exactly these pixels, set on load and empty if
+    // they were transformed (oriented, flipped, premultiplied...) on the way
+    [[nodiscard]] auto identical_file() const -> const std::string & { return identical_path; }
+    // the file the command asked for, filename() may be a cached copy of it
+    [[nodiscard]] auto source_file() const -> const std::string & { return source_path; }
 
   protected:
+    std::string identical_path;
+    std::string source_path;
+
+    static auto create(const std::shared_ptr<Dimensions> &dimensions, const std::string &image_path, bool in_cache)
+        -> std::unique_ptr<Image>;
+
     [[nodiscard]] auto get_new_sizes(double max_width, double max_height, std::string_view scaler,
                                      int scale_factor = 0) const -> std::pair<int, int>;
+    [[nodiscard]] static auto get_new_sizes(int img_width, int img_height, double max_width, double max_height,
+                                            std::string_view scaler, int scale_factor = 0) -> std::pair<int, int>;
 };
 
 #endif
@@ -57,6 +57,8 @@ class Terminal
 
     void check_sixel_support();
     void check_kitty_support();
+    void check_kitty_mediums();
+    [[nodiscard]] static auto query_kitty_medium(std::string_view medium, std::string_view name) -> bool;
     void check_iterm2_support();
 
     void get_terminal_size_escape_code();
@@ -37,7 +37,6 @@ auto get_process_tree(int pid) -> std::vector<int>;
 auto get_process_tree_v2(int pid) -> std::vector<Process>;
 auto get_b2_hash_ssl(std::string_view str) -> std::string;
 auto get_cache_path() -> std::string;
-auto get_cache_file_save_location(const std::filesystem::path &path) -> std::string;
 auto get_log_filename() -> std::string;
 auto get_socket_path(int pid = os::get_pid()) -> std::string;
 void send_socket_message(std::string_view msg, std::string_view endpoint);
@@ -14,29 +14,30 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
-#ifndef KITTY_CHUNK_H
-#define KITTY_CHUNK_H
+
+#ifndef UTIL_DAMAGE_H
+#define UTIL_DAMAGE_H
 
 #include <vector>
-#include <cstdint>
 
-class KittyChunk
+// Finds the areas that changed between two frames of the same size by
+// comparing them in tiles
+namespace damage
 {
-public:
-    KittyChunk() = default;
-    KittyChunk(const unsigned char* ptr, uint64_t size);
 
-    void operator()(KittyChunk& chunk) const;
+struct Rect {
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+// returns no rects if the frames are identical
+[[nodiscard]] auto diff(const unsigned char *prev, const unsigned char *cur, int width, int height, int channels)
+    -> std::vector<Rect>;
 
-    auto get_result() -> char*;
-    [[nodiscard]] auto get_ptr() const -> const unsigned char*;
-    [[nodiscard]] auto get_size() const -> uint64_t;
+[[nodiscard]] auto full(int width, int height) -> std::vector<Rect>;
 
-    static void process_chunk(KittyChunk& chunk);
-private:
-    const unsigned char* ptr;
-    uint64_t size;
-    std::vector<char> result;
-};
+} // namespace damage
 
 #endif
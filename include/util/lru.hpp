@@ -0,0 +1,111 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef UTIL_LRU_H
+#define UTIL_LRU_H
+
+#include <cstddef>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+// least recently used cache bounded by the sum of the cost of its entries,
+// not thread safe
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache
+{
+  public:
+    explicit LruCache(size_t max_cost)
+        : max_cost(max_cost)
+    {
+    }
+
+    auto get(const Key &key) -> std::optional<Value>
+    {
+        const auto entry = index.find(key);
+        if (entry == index.end()) {
+            return {};
+        }
+        entries.splice(entries.begin(), entries, entry->second);
+        return entry->second->value;
+    }
+
+    // returns false if the value doesn't fit in the cache
+    auto insert(const Key &key, Value value, size_t cost) -> bool
+    {
+        erase(key);
+        if (cost > max_cost) {
+            return false;
+        }
+        entries.push_front({key, std::move(value), cost});
+        index.emplace(key, entries.begin());
+        total_cost += cost;
+        while (total_cost > max_cost) {
+            erase(entries.back().key);
+        }
+        return true;
+    }
+
+    void erase(const Key &key)
+    {
+        const auto entry = index.find(key);
+        if (entry == index.end()) {
+            return;
+        }
+        total_cost -= entry->second->cost;
+        entries.erase(entry->second);
+        index.erase(entry);
+    }
+
+    // removes the least recently used entry
+    auto pop() -> std::optional<std::pair<Key, Value>>
+    {
+        if (entries.empty()) {
+            return {};
+        }
+        auto &oldest = entries.back();
+        std::pair<Key, Value> result{std::move(oldest.key), std::move(oldest.value)};
+        index.erase(result.first);
+        total_cost -= oldest.cost;
+        entries.pop_back();
+        return result;
+    }
+
+    void clear()
+    {
+        entries.clear();
+        index.clear();
+        total_cost = 0;
+    }
+
+    [[nodiscard]] auto cost() const -> size_t { return total_cost; }
+    [[nodiscard]] auto size() const -> size_t { return entries.size(); }
+
+  private:
+    struct Entry {
+        Key key;
+        Value value;
+        size_t cost;
+    };
+
+    std::list<Entry> entries;
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+    size_t max_cost;
+    size_t total_cost = 0;
+};
+
+#endif
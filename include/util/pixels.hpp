@@ -0,0 +1,49 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef UTIL_PIXELS_H
+#define UTIL_PIXELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Pixel format conversion done in a single pass over memory: depth reduction,
+// alpha premultiplication and channel swizzle. The common 8 bit conversions
+// use SSSE3/AVX2 (picked at runtime) or NEON, everything else goes through a
+// scalar loop.
+namespace pixels
+{
+
+enum class Layout : uint8_t {
+    gray,
+    rgb,
+    bgr,
+    rgba,
+    bgra,
+};
+
+[[nodiscard]] auto channels(Layout layout) -> int;
+
+// src and dst may be the same buffer if both layouts have the same amount of channels
+void convert(const unsigned char *src, Layout from, unsigned char *dst, Layout to, size_t count,
+             bool premultiply = false);
+
+// 16 bit input, reduced to 8 bits on the way
+void convert(const uint16_t *src, Layout from, unsigned char *dst, Layout to, size_t count, bool premultiply = false);
+
+} // namespace pixels
+
+#endif
@@ -0,0 +1,122 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef UTIL_SCHEDULER_H
+#define UTIL_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Drives every animation from a single thread. Frames are due at absolute
+// deadlines, so the time spent drawing doesn't push the following frames
+// back. Frames that are already late when their turn comes are skipped.
+class AnimationScheduler
+{
+  public:
+    // advances an animation to its next frame, drawing it only if present is
+    // true. returns the milliseconds until the frame after it is due, or a
+    // negative value once the animation is over
+    using step_t = std::function<int(bool present)>;
+
+    // stops the animation when destroyed, waiting for a step that is running
+    class Handle
+    {
+      public:
+        Handle() = default;
+        Handle(std::shared_ptr<AnimationScheduler> scheduler, uint64_t id);
+        ~Handle();
+
+        Handle(Handle &&other) noexcept;
+        auto operator=(Handle &&other) noexcept -> Handle &;
+        Handle(const Handle &) = delete;
+        auto operator=(const Handle &) -> Handle & = delete;
+
+        void reset();
+        // a paused animation runs no steps until it is resumed, resuming
+        // draws the next frame right away
+        void pause() const;
+        void resume() const;
+        explicit operator bool() const;
+
+      private:
+        std::shared_ptr<AnimationScheduler> scheduler;
+        uint64_t id = 0;
+    };
+
+    static auto instance() -> std::shared_ptr<AnimationScheduler>
+    {
+        static std::shared_ptr<AnimationScheduler> instance{new AnimationScheduler};
+        return instance;
+    }
+
+    ~AnimationScheduler();
+    AnimationScheduler(const AnimationScheduler &) = delete;
+    auto operator=(const AnimationScheduler &) -> AnimationScheduler & = delete;
+
+    // the first step runs delay milliseconds from now
+    [[nodiscard]] auto add(int delay, step_t step) -> Handle;
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    struct Deadline {
+        clock::time_point due;
+        uint64_t id;
+        // deadlines queued before a pause are dropped
+        uint64_t generation;
+    };
+
+    struct Animation {
+        std::shared_ptr<step_t> step;
+        uint64_t generation = 0;
+        bool paused = false;
+    };
+
+    struct Later {
+        auto operator()(const Deadline &lhs, const Deadline &rhs) const -> bool
+        {
+            return lhs.due > rhs.due;
+        }
+    };
+
+    AnimationScheduler();
+
+    void remove(uint64_t id);
+    void pause(uint64_t id);
+    void resume(uint64_t id);
+    void run();
+
+    std::mutex scheduler_mutex;
+    std::condition_variable scheduler_cv;
+    std::priority_queue<Deadline, std::vector<Deadline>, Later> deadlines;
+    // a running step is kept alive by the worker even if it gets removed
+    std::unordered_map<uint64_t, Animation> animations;
+    uint64_t next_id = 1;
+    uint64_t running = 0;
+    bool stop = false;
+
+    std::thread worker;
+};
+
+#endif
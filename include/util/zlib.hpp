@@ -14,39 +14,21 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
-#include "chunk.hpp"
-#include "util.hpp"
 
-KittyChunk::KittyChunk(const unsigned char* ptr, uint64_t size):
-ptr(ptr),
-size(size)
-{
-    uint64_t bufsize = 4*((size+2)/3);
-    result.resize(bufsize + 1, 0);
-}
+#ifndef UTIL_ZLIB_H
+#define UTIL_ZLIB_H
 
-void KittyChunk::process_chunk(KittyChunk& chunk)
-{
-    util::base64_encode_v2(chunk.get_ptr(), chunk.get_size(),
-            reinterpret_cast<unsigned char*>(chunk.get_result()));
-}
+#include <cstddef>
+#include <vector>
 
-void KittyChunk::operator()(KittyChunk& chunk) const
+namespace zlib
 {
-    process_chunk(chunk);
-}
 
-auto KittyChunk::get_result() -> char*
-{
-    return result.data();
-}
+// Produces a single zlib stream from blocks compressed in parallel. Every
+// block but the last ends on a sync flush so their raw deflate streams can
+// be concatenated, and their checksums are combined afterwards.
+[[nodiscard]] auto compress(const unsigned char *data, size_t size) -> std::vector<unsigned char>;
 
-auto KittyChunk::get_ptr() const -> const unsigned char*
-{
-    return ptr;
-}
+} // namespace zlib
 
-auto KittyChunk::get_size() const -> uint64_t
-{
-    return size;
-}
+#endif
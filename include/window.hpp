@@ -25,7 +25,11 @@ class Window
 public:
     virtual ~Window() = default;
     virtual void draw() = 0;
+    // redraws part of the window, windows that can't do that redraw everything
+    virtual void draw_area(int /*xcoord*/, int /*ycoord*/, int /*width*/, int /*height*/) { draw(); }
     virtual void generate_frame() = 0;
+    // frames were skipped without being drawn, the next one is drawn whole
+    virtual void invalidate() {};
     virtual void show() {};
     virtual void hide() {};
 };
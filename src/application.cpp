@@ -15,6 +15,7 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "application.hpp"
+#include "cache/disk.hpp"
 #include "image.hpp"
 #include "tmux.hpp"
 #include "util.hpp"
@@ -50,6 +51,10 @@ Application::Application(const char *executable)
         fs::create_directories(cache_path);
     }
     tmux::register_hooks();
+    decoder = std::make_unique<Decoder>(
+        terminal.get(), [this](const std::string &identifier, uint64_t generation, std::unique_ptr<Image> image) {
+            add_image(identifier, generation, std::move(image));
+        });
     socket_thread = std::thread([this] {
         const auto sock_path = util::get_socket_path();
         logger->info("Listening for commands on socket {}", sock_path);
@@ -57,6 +62,8 @@ Application::Application(const char *executable)
     });
     if (flags->no_cache) {
         logger->info("Image caching is disabled");
+    } else {
+        cache_thread = std::thread(&Application::cache_loop, this);
     }
     if (VIPS_INIT(executable)) {
         vips_error_exit(nullptr);
@@ -69,7 +76,11 @@ Application::~Application()
     if (socket_thread.joinable()) {
         socket_thread.join();
     }
+    if (cache_thread.joinable()) {
+        cache_thread.join();
+    }
     logger->info("Exiting ueberzugpp");
+    decoder.reset();
     canvas.reset();
     vips_shutdown();
     tmux::unregister_hooks();
@@ -98,25 +109,49 @@ void Application::execute(const std::string_view cmd)
         return;
     }
 
-    const std::string &identifier = json.at("identifier");
+    if (action == "prefetch") {
+        std::vector<njson> commands;
+        for (const auto &path : json.value("paths", njson::array())) {
+            if (!path.is_string()) {
+                continue;
+            }
+            commands.push_back({{"path", path},
+                                {"max_width", json.at("max_width")},
+                                {"max_height", json.at("max_height")},
+                                {"x", 0},
+                                {"y", 0},
+                                {"scaler", json.value("scaler", "contain")}});
+        }
+        decoder->prefetch(std::move(commands));
+        return;
+    }
+
+    const std::string identifier = json.at("identifier");
     if (action == "add") {
         if (!json.at("path").is_string()) {
             logger->error("Path received is not valid");
             return;
         }
-        auto image = Image::load(json, terminal.get());
-        if (!image) {
-            logger->error("Unable to load image file");
-            return;
-        }
-        canvas->add_image(identifier, std::move(image));
+        decoder->submit(identifier, std::move(json));
     } else if (action == "remove") {
+        const std::scoped_lock lock{canvas_mutex};
+        decoder->cancel(identifier);
         canvas->remove_image(identifier);
     } else {
         logger->warn("Command not supported");
     }
 }
 
+void Application::add_image(const std::string &identifier, uint64_t generation, std::unique_ptr<Image> image)
+{
+    const std::scoped_lock lock{canvas_mutex};
+    if (!decoder->is_latest(identifier, generation)) {
+        logger->debug("Discarding outdated image for id {}", identifier);
+        return;
+    }
+    canvas->add_image(identifier, std::move(image));
+}
+
 void Application::handle_tmux_hook(const std::string_view hook)
 {
     const std::unordered_map<std::string_view, std::function<void()>> hook_fns{
@@ -146,6 +181,7 @@ void Application::handle_tmux_hook(const std::string_view hook)
     };
 
     try {
+        const std::scoped_lock lock{canvas_mutex};
         hook_fns.at(hook)();
     } catch (const std::out_of_range &oor) {
         logger->warn("TMUX hook not recognized");
@@ -240,6 +276,51 @@ void Application::socket_loop()
     }
 }
 
+void Application::cache_loop()
+{
+    using std::chrono::steady_clock;
+    const auto interval = std::chrono::minutes(10);
+    const auto waitms = std::chrono::milliseconds(100);
+    const auto disk_cache = DiskCache::instance();
+
+    // prune on startup, periodically and whenever the size limit is exceeded.
+    // If another instance holds the index, wait for the next interval
+    auto next_prune = steady_clock::now();
+    bool locked_out = false;
+    while (!stop_flag) {
+        if (steady_clock::now() >= next_prune || (!locked_out && disk_cache->needs_pruning())) {
+            locked_out = !disk_cache->prune().has_value();
+            next_prune = steady_clock::now() + interval;
+        }
+        std::this_thread::sleep_for(waitms);
+    }
+}
+
+void Application::handle_cache_command()
+{
+    const auto flags = Flags::instance();
+    const auto disk_cache = DiskCache::instance();
+    const double bytes_per_mib = 1024 * 1024;
+    if (flags->cache_prune) {
+        const auto removed = disk_cache->prune();
+        if (!removed.has_value()) {
+            std::cerr << "Could not lock the cache index, another instance is using it\n";
+        } else {
+            std::cout << fmt::format("Removed {} files ({:.2f} MiB)", removed->files,
+                                     removed->bytes / bytes_per_mib)
+                      << '\n';
+        }
+    }
+    if (flags->cache_prune && !flags->cache_stats) {
+        return;
+    }
+    const auto stats = disk_cache->stats();
+    std::cout << fmt::format("Cache directory: {}\n", util::get_cache_path())
+              << fmt::format("Images: {}\n", stats.sources) << fmt::format("Files: {}\n", stats.files)
+              << fmt::format("Size: {:.2f} MiB of {} MiB\n", stats.bytes / bytes_per_mib, flags->cache_max_size)
+              << std::flush;
+}
+
 void Application::print_header()
 {
     const auto log_tmp = util::get_log_filename();
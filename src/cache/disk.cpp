@@ -0,0 +1,402 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "disk.hpp"
+#include "flags.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <unordered_set>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+using njson = nlohmann::json;
+
+constexpr uintmax_t bytes_per_mib = 1024 * 1024;
+constexpr int hours_per_day = 24;
+
+// flock on the lock file next to the index, held while the object lives
+class IndexLock
+{
+  public:
+    IndexLock(const fs::path &path, int operation)
+        : fd(open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR))
+    {
+        if (fd == -1) {
+            return;
+        }
+        while (flock(fd, operation) == -1) {
+            if (errno != EINTR) {
+                close(fd);
+                fd = -1;
+                return;
+            }
+        }
+    }
+    ~IndexLock()
+    {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+    IndexLock(const IndexLock &) = delete;
+    auto operator=(const IndexLock &) -> IndexLock & = delete;
+
+    [[nodiscard]] auto locked() const -> bool { return fd != -1; }
+
+  private:
+    int fd;
+};
+
+DiskCache::DiskCache()
+    : cache_path(util::get_cache_path()),
+      index_path(cache_path / "index"),
+      lock_path(cache_path / "index.lock"),
+      max_bytes(static_cast<uintmax_t>(Flags::instance()->cache_max_size) * bytes_per_mib),
+      max_age(Flags::instance()->cache_max_age * hours_per_day)
+{
+    logger = spdlog::get("main");
+    if (!logger) {
+        // not running as a layer, discard messages
+        logger = std::make_shared<spdlog::logger>("cache");
+    }
+    const std::scoped_lock lock{cache_mutex};
+    read_index();
+}
+
+auto DiskCache::source_key(const fs::path &source) -> std::optional<std::string>
+{
+    std::error_code err;
+    const auto mtime = fs::last_write_time(source, err);
+    if (err) {
+        return {};
+    }
+    const auto file_size = fs::file_size(source, err);
+    if (err) {
+        return {};
+    }
+    return util::get_b2_hash_ssl(
+        fmt::format("{}|{}|{}", fs::absolute(source).string(), mtime.time_since_epoch().count(), file_size));
+}
+
+auto DiskCache::save_location(const fs::path &source, int width, int height, const std::string &extension)
+    -> std::optional<std::string>
+{
+    const auto key = source_key(source);
+    if (!key.has_value()) {
+        return {};
+    }
+    return fmt::format("{}{}-{}x{}{}", util::get_cache_path(), key.value(), width, height,
+                       extension.empty() ? source.extension().string() : extension);
+}
+
+auto DiskCache::fits(int width, int height, const Dimensions &dimensions) -> bool
+{
+    const int dim_width = dimensions.max_wpixels();
+    const int dim_height = dimensions.max_hpixels();
+    const int delta = 10;
+    return dim_width >= width && dim_height >= height &&
+           ((dim_width - width) <= delta || (dim_height - height) <= delta);
+}
+
+auto DiskCache::find(const fs::path &source, const Dimensions &dimensions, const std::string &format)
+    -> std::optional<std::string>
+{
+    const auto key = source_key(source);
+    if (!key.has_value()) {
+        return {};
+    }
+    const std::scoped_lock lock{cache_mutex};
+    auto location = find_variant(key.value(), dimensions, format);
+    if (location.has_value()) {
+        return location;
+    }
+    // other instances might have added entries
+    read_index();
+    return find_variant(key.value(), dimensions, format);
+}
+
+auto DiskCache::find_variant(const std::string &key, const Dimensions &dimensions, const std::string &format)
+    -> std::optional<std::string>
+{
+    const auto variants = entries.find(key);
+    if (variants == entries.end()) {
+        return {};
+    }
+    const auto entry = std::ranges::find_if(variants->second, [&dimensions, &format](const CacheEntry &variant) {
+        return variant.format == format && fits(variant.width, variant.height, dimensions);
+    });
+    if (entry == variants->second.end()) {
+        return {};
+    }
+    auto location = cache_path / entry->file;
+    // refresh the access time used for eviction
+    std::error_code err;
+    fs::last_write_time(location, fs::file_time_type::clock::now(), err);
+    if (err) {
+        total_bytes -= entry->bytes;
+        variants->second.erase(entry);
+        return {};
+    }
+    return location.string();
+}
+
+void DiskCache::insert(const fs::path &location, int width, int height, const std::string &format)
+{
+    const auto file = location.filename().string();
+    std::error_code err;
+    const auto bytes = fs::file_size(location, err);
+    if (err) {
+        return;
+    }
+    const njson record = {{"key", file.substr(0, file.find('-'))},
+                          {"file", file},
+                          {"width", width},
+                          {"height", height},
+                          {"bytes", bytes},
+                          {"format", format}};
+
+    const std::scoped_lock lock{cache_mutex};
+    apply_record(record);
+    append_record(record);
+}
+
+// reads the records appended since the last call, returns true if the whole
+// index has been read. A missing index, e.g. before the first insert, is empty
+auto DiskCache::read_index() -> bool
+{
+    struct stat info {};
+    if (stat(index_path.c_str(), &info) == -1) {
+        if (errno != ENOENT) {
+            return false;
+        }
+        entries.clear();
+        total_bytes = 0;
+        index_offset = 0;
+        index_inode = 0;
+        return true;
+    }
+    std::ifstream ifs(index_path);
+    if (!ifs.is_open()) {
+        return false;
+    }
+    if (info.st_ino != index_inode || info.st_size < index_offset) {
+        // compacted by another instance, start over
+        entries.clear();
+        total_bytes = 0;
+        index_offset = 0;
+        index_inode = info.st_ino;
+    }
+    ifs.seekg(index_offset);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (ifs.eof()) {
+            // incomplete record, still being written
+            return false;
+        }
+        index_offset = ifs.tellg();
+        try {
+            apply_record(njson::parse(line));
+        } catch (const njson::exception &) {
+            logger->debug("Skipping invalid cache index record");
+        }
+    }
+    return true;
+}
+
+void DiskCache::append_record(const njson &record)
+{
+    // keeps the index from being replaced while the record is written
+    const IndexLock index_lock{lock_path, LOCK_SH};
+    std::ofstream ofs(index_path, std::ios::out | std::ios::app);
+    ofs << record.dump() << '\n' << std::flush;
+}
+
+void DiskCache::apply_record(const njson &record)
+{
+    const std::string &key = record.at("key");
+    const std::string &file = record.at("file");
+    auto &variants = entries[key];
+    std::erase_if(variants, [this, &file](const CacheEntry &variant) {
+        if (variant.file != file) {
+            return false;
+        }
+        total_bytes -= variant.bytes;
+        return true;
+    });
+    if (record.value("removed", false)) {
+        if (variants.empty()) {
+            entries.erase(key);
+        }
+        return;
+    }
+    variants.push_back({file, record.at("width"), record.at("height"), record.at("bytes"),
+                        record.value("format", "image")});
+    total_bytes += variants.back().bytes;
+}
+
+auto DiskCache::stats() -> CacheStats
+{
+    const std::scoped_lock lock{cache_mutex};
+    read_index();
+    CacheStats result;
+    result.sources = entries.size();
+    for (const auto &[key, variants] : entries) {
+        result.files += variants.size();
+    }
+    result.bytes = total_bytes;
+    return result;
+}
+
+auto DiskCache::needs_pruning() -> bool
+{
+    const std::scoped_lock lock{cache_mutex};
+    return total_bytes > max_bytes;
+}
+
+auto DiskCache::prune() -> std::optional<CacheStats>
+{
+    struct StoredFile {
+        std::string key;
+        CacheEntry entry;
+        fs::file_time_type last_access;
+    };
+
+    const std::scoped_lock lock{cache_mutex};
+    // other instances can't append or compact until the new index is in place
+    const IndexLock index_lock{lock_path, LOCK_EX};
+    if (!index_lock.locked()) {
+        logger->warn("Could not lock the cache index, not pruning");
+        return {};
+    }
+    const bool read_all = read_index();
+
+    CacheStats removed;
+    std::vector<StoredFile> files;
+    std::error_code err;
+    for (const auto &[key, variants] : entries) {
+        for (const auto &variant : variants) {
+            const auto last_access = fs::last_write_time(cache_path / variant.file, err);
+            if (err) {
+                continue;
+            }
+            files.push_back({key, variant, last_access});
+        }
+    }
+    std::ranges::sort(files, {}, &StoredFile::last_access);
+
+    const auto now = fs::file_time_type::clock::now();
+    uintmax_t kept_bytes = 0;
+    for (const auto &file : files) {
+        kept_bytes += file.entry.bytes;
+    }
+    auto first_kept = files.begin();
+    for (; first_kept != files.end(); ++first_kept) {
+        const bool too_old = max_age.count() > 0 && now - first_kept->last_access > max_age;
+        if (!too_old && kept_bytes <= max_bytes) {
+            break;
+        }
+        fs::remove(cache_path / first_kept->entry.file, err);
+        kept_bytes -= first_kept->entry.bytes;
+        removed.bytes += first_kept->entry.bytes;
+        ++removed.files;
+    }
+
+    entries.clear();
+    total_bytes = 0;
+    for (auto file = first_kept; file != files.end(); ++file) {
+        entries[file->key].push_back(file->entry);
+        total_bytes += file->entry.bytes;
+    }
+
+    rewrite_index();
+    if (read_all) {
+        remove_unindexed(removed);
+    }
+    logger->info("Pruned {} files ({} bytes) from the cache", removed.files, removed.bytes);
+    return removed;
+}
+
+// files not referenced by the index, e.g. from older versions, are removed
+// once they are old enough not to be in the middle of being indexed. Only
+// valid with the whole index read under the exclusive lock
+void DiskCache::remove_unindexed(CacheStats &removed)
+{
+    const auto now = fs::file_time_type::clock::now();
+    std::error_code err;
+    const auto grace_period = std::chrono::minutes(10);
+    std::unordered_set<std::string> indexed;
+    for (const auto &[key, variants] : entries) {
+        for (const auto &variant : variants) {
+            indexed.insert(variant.file);
+        }
+    }
+    for (const auto &dir_entry : fs::directory_iterator(cache_path, err)) {
+        const auto file = dir_entry.path().filename().string();
+        if (!dir_entry.is_regular_file(err) || file.starts_with("index") || indexed.contains(file)) {
+            continue;
+        }
+        if (now - dir_entry.last_write_time(err) < grace_period) {
+            continue;
+        }
+        const auto bytes = dir_entry.file_size(err);
+        if (fs::remove(dir_entry.path(), err)) {
+            removed.bytes += bytes;
+            ++removed.files;
+        }
+    }
+}
+
+void DiskCache::rewrite_index()
+{
+    const auto tmp_path = fs::path(index_path).concat(".tmp");
+    {
+        std::ofstream ofs(tmp_path, std::ios::out | std::ios::trunc);
+        for (const auto &[key, variants] : entries) {
+            for (const auto &variant : variants) {
+                const njson record = {{"key", key},
+                                      {"file", variant.file},
+                                      {"width", variant.width},
+                                      {"height", variant.height},
+                                      {"bytes", variant.bytes},
+                                      {"format", variant.format}};
+                ofs << record.dump() << '\n';
+            }
+        }
+        if (!ofs.flush()) {
+            return;
+        }
+    }
+    std::error_code err;
+    fs::rename(tmp_path, index_path, err);
+    if (err) {
+        return;
+    }
+    struct stat info {};
+    if (stat(index_path.c_str(), &info) == -1) {
+        return;
+    }
+    index_offset = static_cast<std::streamoff>(info.st_size);
+    index_inode = info.st_ino;
+}
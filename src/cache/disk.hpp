@@ -0,0 +1,109 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DISK_CACHE_H
+#define DISK_CACHE_H
+
+#include "dimensions.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+struct CacheEntry {
+    std::string file;
+    int width = 0;
+    int height = 0;
+    uintmax_t bytes = 0;
+    std::string format = "image";
+};
+
+struct CacheStats {
+    size_t sources = 0;
+    size_t files = 0;
+    uintmax_t bytes = 0;
+};
+
+// Resized images are stored as <source key>-<width>x<height>.<ext>, the source
+// key is derived from the path, mtime and size of the original file. An append
+// only index in the cache directory maps every source to its stored variants so
+// a lookup never has to open an image. The modification time of a stored file
+// is refreshed on every hit and used to evict the least recently used files.
+// Appending to the index takes a shared lock on index.lock, compacting it takes
+// an exclusive one.
+class DiskCache
+{
+  public:
+    static auto instance() -> std::shared_ptr<DiskCache>
+    {
+        static std::shared_ptr<DiskCache> instance{new DiskCache};
+        return instance;
+    }
+
+    DiskCache(const DiskCache &) = delete;
+    auto operator=(const DiskCache &) -> DiskCache & = delete;
+
+    [[nodiscard]] auto find(const std::filesystem::path &source, const Dimensions &dimensions,
+                            const std::string &format = "image") -> std::optional<std::string>;
+    [[nodiscard]] static auto save_location(const std::filesystem::path &source, int width, int height,
+                                            const std::string &extension = "") -> std::optional<std::string>;
+    [[nodiscard]] static auto fits(int width, int height, const Dimensions &dimensions) -> bool;
+    void insert(const std::filesystem::path &location, int width, int height, const std::string &format = "image");
+
+    [[nodiscard]] auto stats() -> CacheStats;
+    [[nodiscard]] auto needs_pruning() -> bool;
+    // empty if another instance holds the index
+    auto prune() -> std::optional<CacheStats>;
+
+  private:
+    DiskCache();
+
+    std::mutex cache_mutex;
+    std::filesystem::path cache_path;
+    std::filesystem::path index_path;
+    std::filesystem::path lock_path;
+    std::streamoff index_offset = 0;
+    // other instances compact the index into a new file
+    ino_t index_inode = 0;
+    std::unordered_map<std::string, std::vector<CacheEntry>> entries;
+    uintmax_t total_bytes = 0;
+    uintmax_t max_bytes;
+    std::chrono::hours max_age;
+
+    std::shared_ptr<spdlog::logger> logger;
+
+    static auto source_key(const std::filesystem::path &source) -> std::optional<std::string>;
+    auto find_variant(const std::string &key, const Dimensions &dimensions, const std::string &format)
+        -> std::optional<std::string>;
+    auto read_index() -> bool;
+    void append_record(const nlohmann::json &record);
+    void apply_record(const nlohmann::json &record);
+    void rewrite_index();
+    void remove_unindexed(CacheStats &removed);
+};
+
+#endif
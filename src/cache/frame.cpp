@@ -0,0 +1,80 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "frame.hpp"
+#include "flags.hpp"
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+
+constexpr size_t bytes_per_mib = 1024 * 1024;
+
+FrameCache::FrameCache()
+    : cache(static_cast<size_t>(Flags::instance()->frame_cache_size) * bytes_per_mib),
+      enabled(Flags::instance()->frame_cache_size > 0)
+{
+    logger = spdlog::get("main");
+}
+
+auto FrameCache::make_key(const fs::path &path, const Dimensions &dimensions) const -> std::optional<std::string>
+{
+    if (!enabled) {
+        return {};
+    }
+    std::error_code err;
+    const auto mtime = fs::last_write_time(path, err);
+    if (err) {
+        return {};
+    }
+    const auto file_size = fs::file_size(path, err);
+    if (err) {
+        return {};
+    }
+    const auto flags = Flags::instance();
+    return fmt::format("{}|{}|{}|{}x{}|{}|{}|{}|{}", fs::absolute(path).string(), mtime.time_since_epoch().count(),
+                       file_size, dimensions.max_wpixels(), dimensions.max_hpixels(), dimensions.scaler,
+                       flags->output, flags->scale_factor, flags->use_opengl);
+}
+
+auto FrameCache::get(const std::string &key) -> std::shared_ptr<const Frame>
+{
+    const std::scoped_lock lock{cache_mutex};
+    auto frame = cache.get(key);
+    if (!frame.has_value()) {
+        ++misses;
+        logger->debug("Frame cache miss (hits: {}, misses: {})", hits, misses);
+        return nullptr;
+    }
+    ++hits;
+    logger->debug("Frame cache hit (hits: {}, misses: {})", hits, misses);
+    return frame.value();
+}
+
+void FrameCache::insert(const std::string &key, const Image &image)
+{
+    auto frame = std::make_shared<Frame>();
+    frame->pixels.resize(image.size());
+    image.write_to(frame->pixels.data());
+    frame->filename = image.filename();
+    frame->width = image.width();
+    frame->height = image.height();
+    frame->channels = image.channels();
+
+    const std::scoped_lock lock{cache_mutex};
+    cache.insert(key, std::move(frame), image.size());
+    logger->debug("Frame cache holds {} images ({} bytes)", cache.size(), cache.cost());
+}
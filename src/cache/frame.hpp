@@ -0,0 +1,72 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include "dimensions.hpp"
+#include "image.hpp"
+#include "util/lru.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+struct Frame {
+    std::vector<unsigned char> pixels;
+    std::string filename;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+};
+
+// keeps the last displayed images in memory, ready to be drawn
+class FrameCache
+{
+  public:
+    static auto instance() -> std::shared_ptr<FrameCache>
+    {
+        static std::shared_ptr<FrameCache> instance{new FrameCache};
+        return instance;
+    }
+
+    FrameCache(const FrameCache &) = delete;
+    auto operator=(const FrameCache &) -> FrameCache & = delete;
+
+    [[nodiscard]] auto make_key(const std::filesystem::path &path, const Dimensions &dimensions) const
+        -> std::optional<std::string>;
+    auto get(const std::string &key) -> std::shared_ptr<const Frame>;
+    void insert(const std::string &key, const Image &image);
+
+  private:
+    FrameCache();
+
+    std::mutex cache_mutex;
+    LruCache<std::string, std::shared_ptr<const Frame>> cache;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    bool enabled;
+
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+#endif
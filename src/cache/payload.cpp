@@ -0,0 +1,158 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "payload.hpp"
+#include "disk.hpp"
+#include "flags.hpp"
+#include "util.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#include <fmt/format.h>
+
+namespace fs = std::filesystem;
+
+constexpr size_t bytes_per_mib = 1024 * 1024;
+
+PayloadCache::PayloadCache()
+    : cache(static_cast<size_t>(Flags::instance()->payload_cache_size) * bytes_per_mib),
+      enabled(Flags::instance()->payload_cache_size > 0 || Flags::instance()->payload_cache_disk),
+      use_disk(Flags::instance()->payload_cache_disk && !Flags::instance()->no_cache)
+{
+    logger = spdlog::get("main");
+    if (!logger) {
+        // not running as a layer, discard messages
+        logger = std::make_shared<spdlog::logger>("payload");
+    }
+}
+
+auto PayloadCache::make_key(const Image &image, std::string_view backend, std::string_view options) const
+    -> std::optional<PayloadKey>
+{
+    if (!enabled) {
+        return {};
+    }
+    // the cached copy an image may be read from gets touched on every hit,
+    // only the file the command asked for identifies the payload
+    const fs::path source = image.source_file();
+    if (source.empty()) {
+        return {};
+    }
+    std::error_code err;
+    const auto mtime = fs::last_write_time(source, err);
+    if (err) {
+        return {};
+    }
+    const auto file_size = fs::file_size(source, err);
+    if (err) {
+        return {};
+    }
+    PayloadKey key;
+    key.source = source.string();
+    key.dimensions = &image.dimensions();
+    key.width = image.width();
+    key.height = image.height();
+    key.format = fmt::format("{}|{}x{}x{}|{}", backend, image.width(), image.height(), image.channels(), options);
+    key.id = fmt::format("{}|{}|{}|{}", fs::absolute(source).string(), mtime.time_since_epoch().count(), file_size,
+                         key.format);
+    return key;
+}
+
+auto PayloadCache::get(const PayloadKey &key) -> std::shared_ptr<const std::string>
+{
+    {
+        const std::scoped_lock lock{cache_mutex};
+        auto payload = cache.get(key.id);
+        if (payload.has_value()) {
+            ++hits;
+            logger->debug("Payload cache hit (hits: {}, misses: {})", hits, misses);
+            return payload.value();
+        }
+    }
+    auto payload = read_from_disk(key);
+
+    const std::scoped_lock lock{cache_mutex};
+    if (!payload) {
+        ++misses;
+        logger->debug("Payload cache miss (hits: {}, misses: {})", hits, misses);
+        return nullptr;
+    }
+    ++hits;
+    logger->debug("Payload cache hit on disk (hits: {}, misses: {})", hits, misses);
+    cache.insert(key.id, payload, payload->size());
+    return payload;
+}
+
+void PayloadCache::insert(const PayloadKey &key, std::string payload)
+{
+    write_to_disk(key, payload);
+    auto shared = std::make_shared<const std::string>(std::move(payload));
+
+    const std::scoped_lock lock{cache_mutex};
+    cache.insert(key.id, shared, shared->size());
+    logger->debug("Payload cache holds {} payloads ({} bytes)", cache.size(), cache.cost());
+}
+
+auto PayloadCache::read_from_disk(const PayloadKey &key) -> std::shared_ptr<const std::string>
+{
+    if (!use_disk) {
+        return nullptr;
+    }
+    const auto location = DiskCache::instance()->find(key.source, *key.dimensions, key.format);
+    if (!location.has_value()) {
+        return nullptr;
+    }
+    std::ifstream ifs(location.value(), std::ios::binary);
+    auto payload = std::make_shared<std::string>(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    if (ifs.bad() || payload->empty()) {
+        return nullptr;
+    }
+    return payload;
+}
+
+// payloads are stored like the resized images, the extension tells apart
+// backends and their options
+void PayloadCache::write_to_disk(const PayloadKey &key, const std::string &payload) const
+{
+    if (!use_disk || !DiskCache::fits(key.width, key.height, *key.dimensions)) {
+        // would never be found by a lookup
+        return;
+    }
+    const auto extension = fmt::format(".{}", util::get_b2_hash_ssl(key.format).substr(0, 16));
+    const auto save_location = DiskCache::save_location(key.source, key.width, key.height, extension);
+    if (!save_location.has_value()) {
+        return;
+    }
+    const auto tmp_location = fmt::format("{}.tmp", save_location.value());
+    {
+        std::ofstream ofs(tmp_location, std::ios::out | std::ios::binary | std::ios::trunc);
+        ofs.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        if (!ofs.flush()) {
+            std::error_code err;
+            fs::remove(tmp_location, err);
+            return;
+        }
+    }
+    std::error_code err;
+    fs::rename(tmp_location, save_location.value(), err);
+    if (err) {
+        return;
+    }
+    DiskCache::instance()->insert(save_location.value(), key.width, key.height, key.format);
+    logger->debug("Saved payload {}", save_location.value());
+}
@@ -0,0 +1,80 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef PAYLOAD_CACHE_H
+#define PAYLOAD_CACHE_H
+
+#include "dimensions.hpp"
+#include "image.hpp"
+#include "util/lru.hpp"
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <spdlog/spdlog.h>
+
+struct PayloadKey {
+    std::string source;
+    // of the image the key was made for, valid as long as the image
+    const Dimensions *dimensions = nullptr;
+    int width = 0;
+    int height = 0;
+    // backend and its options, also tells apart the variants on disk
+    std::string format;
+    std::string id;
+};
+
+// keeps what the terminal backends wrote for an image, a later preview of
+// the same image writes it again without encoding. Payloads can also be
+// stored in the disk cache next to the resized images
+class PayloadCache
+{
+  public:
+    static auto instance() -> std::shared_ptr<PayloadCache>
+    {
+        static std::shared_ptr<PayloadCache> instance{new PayloadCache};
+        return instance;
+    }
+
+    PayloadCache(const PayloadCache &) = delete;
+    auto operator=(const PayloadCache &) -> PayloadCache & = delete;
+
+    // options holds anything besides the pixels that changes the output
+    [[nodiscard]] auto make_key(const Image &image, std::string_view backend, std::string_view options = "") const
+        -> std::optional<PayloadKey>;
+    auto get(const PayloadKey &key) -> std::shared_ptr<const std::string>;
+    void insert(const PayloadKey &key, std::string payload);
+
+  private:
+    PayloadCache();
+
+    std::mutex cache_mutex;
+    LruCache<std::string, std::shared_ptr<const std::string>> cache;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    bool enabled;
+    bool use_disk;
+
+    std::shared_ptr<spdlog::logger> logger;
+
+    auto read_from_disk(const PayloadKey &key) -> std::shared_ptr<const std::string>;
+    void write_to_disk(const PayloadKey &key, const std::string &payload) const;
+};
+
+#endif
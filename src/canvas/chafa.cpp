@@ -15,6 +15,7 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "chafa.hpp"
+#include "../cache/payload.hpp"
 #include "dimensions.hpp"
 #include "terminal.hpp"
 #include "util.hpp"
@@ -24,6 +25,7 @@
 #include <cmath>
 #include <iostream>
 
+#include <fmt/format.h>
 #include <range/v3/all.hpp>
 #include <spdlog/spdlog.h>
 
@@ -68,6 +70,37 @@ Chafa::~Chafa()
 }
 
 void Chafa::draw()
+{
+    // the symbols depend on the terminal and the cells they cover
+    const auto payload_cache = PayloadCache::instance();
+    const auto key = payload_cache->make_key(
+        *image, "chafa", fmt::format("{}|{}x{}", chafa_term_info_get_name(term_info), horizontal_cells, vertical_cells));
+    std::shared_ptr<const std::string> payload;
+    if (key.has_value()) {
+        payload = payload_cache->get(key.value());
+    }
+    if (!payload) {
+        payload = std::make_shared<const std::string>(print_rows());
+        if (key.has_value()) {
+            payload_cache->insert(key.value(), *payload);
+        }
+    }
+
+    auto ycoord = y;
+    const auto lines = util::str_split(*payload, "\n");
+
+    const std::scoped_lock lock{*stdout_mutex};
+    util::save_cursor_position();
+    ranges::for_each(lines, [this, &ycoord](const std::string &line) {
+        util::move_cursor(ycoord++, x);
+        std::cout << line;
+    });
+    std::cout << std::flush;
+    util::restore_cursor_position();
+}
+
+// one line of symbols per row of cells
+auto Chafa::print_rows() -> std::string
 {
     canvas = chafa_canvas_new(config);
     chafa_canvas_draw_all_pixels(canvas, CHAFA_PIXEL_BGRA8_UNASSOCIATED, image->data(), image->width(), image->height(),
@@ -78,27 +111,18 @@ void Chafa::draw()
     gint lines_length = 0;
 
     chafa_canvas_print_rows(canvas, term_info, &lines, &lines_length);
-    auto ycoord = y;
-    const std::scoped_lock lock{*stdout_mutex};
-    util::save_cursor_position();
+    std::string result;
     for (int i = 0; i < lines_length; ++i) {
         const auto line = c_unique_ptr<GString, gstring_delete>{lines[i]};
-        util::move_cursor(ycoord++, x);
-        std::cout << line->str;
+        if (i > 0) {
+            result.push_back('\n');
+        }
+        result.append(line->str, line->len);
     }
     g_free(lines);
+    return result;
 #else
     const auto result = c_unique_ptr<GString, gstring_delete>{chafa_canvas_print(canvas, term_info)};
-    auto ycoord = y;
-    const auto lines = util::str_split(result->str, "\n");
-
-    const std::scoped_lock lock{*stdout_mutex};
-    util::save_cursor_position();
-    ranges::for_each(lines, [this, &ycoord](const std::string &line) {
-        util::move_cursor(ycoord++, x);
-        std::cout << line;
-    });
+    return {result->str, result->len};
 #endif
-    std::cout << std::flush;
-    util::restore_cursor_position();
 }
@@ -22,6 +22,7 @@
 
 #include <memory>
 #include <mutex>
+#include <string>
 
 #include <chafa.h>
 
@@ -47,6 +48,8 @@ class Chafa : public Window
     int y;
     int horizontal_cells = 0;
     int vertical_cells = 0;
+
+    auto print_rows() -> std::string;
 };
 
 #endif
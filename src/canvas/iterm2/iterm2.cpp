@@ -15,6 +15,7 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "iterm2.hpp"
+#include "../../cache/payload.hpp"
 #include "chunk.hpp"
 #include "dimensions.hpp"
 #include "image.hpp"
@@ -58,6 +59,15 @@ Iterm2::~Iterm2()
 
 void Iterm2::draw()
 {
+    const auto payload_cache = PayloadCache::instance();
+    const auto key = payload_cache->make_key(*image, "iterm2");
+    if (key.has_value()) {
+        if (const auto payload = payload_cache->get(key.value())) {
+            write(*payload);
+            return;
+        }
+    }
+
     str.append("\033]1337;File=inline=1;");
     const auto filename = image->filename();
     const auto num_bytes = fs::file_size(filename);
@@ -75,12 +85,20 @@ void Iterm2::draw()
     ranges::for_each(chunks, [this](const std::unique_ptr<Iterm2Chunk> &chunk) { str.append(chunk->get_result()); });
     str.append("\a");
 
+    write(str);
+    if (key.has_value()) {
+        payload_cache->insert(key.value(), std::move(str));
+    }
+    str.clear();
+}
+
+void Iterm2::write(std::string_view payload) const
+{
     const std::scoped_lock lock{*stdout_mutex};
     util::save_cursor_position();
     util::move_cursor(y, x);
-    std::cout << str << std::flush;
+    std::cout << payload << std::flush;
     util::restore_cursor_position();
-    str.clear();
 }
 
 auto Iterm2::process_chunks(const std::string &filename, int chunk_size, size_t num_bytes)
@@ -23,6 +23,7 @@
 
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Iterm2 : public Window
@@ -44,6 +45,7 @@ class Iterm2 : public Window
     int horizontal_cells = 0;
     int vertical_cells = 0;
 
+    void write(std::string_view payload) const;
     static auto process_chunks(const std::string &filename, int chunk_size, size_t num_bytes)
         -> std::vector<std::unique_ptr<Iterm2Chunk>>;
 };
@@ -16,11 +16,31 @@
 
 #include "kitty.hpp"
 #include "dimensions.hpp"
+#include "flags.hpp"
+#include "os.hpp"
+#include "tmux.hpp"
 #include "util.hpp"
 
+#ifdef ENABLE_ZLIB
+#  include "util/zlib.hpp"
+#endif
+
 #include <fmt/format.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <numeric>
+#include <tuple>
 
 #ifdef HAVE_STD_EXECUTION_H
 #  include <execution>
@@ -28,10 +48,13 @@
 #  include <oneapi/tbb.h>
 #endif
 
+namespace fs = std::filesystem;
+
 Kitty::Kitty(std::unique_ptr<Image> new_image, std::mutex *stdout_mutex)
     : image(std::move(new_image)),
       stdout_mutex(stdout_mutex),
-      id(util::generate_random_number<uint32_t>(1))
+      registry(KittyRegistry::instance()),
+      placement(util::generate_random_number<uint32_t>(1))
 {
     const auto dims = image->dimensions();
     x = dims.x + 1;
@@ -40,8 +63,16 @@ Kitty::Kitty(std::unique_ptr<Image> new_image, std::mutex *stdout_mutex)
 
 Kitty::~Kitty()
 {
+    if (!key.has_value()) {
+        return;
+    }
+    // lowercase only deletes the placement, the terminal keeps the data
+    str.append(fmt::format("\033_Ga=d,d=i,i={},p={},q=2\033\\", id, placement));
+    for (const auto evicted : registry->release(*key)) {
+        str.append(fmt::format("\033_Ga=d,d=I,i={},q=2\033\\", evicted));
+    }
     const std::scoped_lock lock{*stdout_mutex};
-    std::cout << fmt::format("\033_Ga=d,d=i,i={}\033\\", id) << std::flush;
+    std::cout << str << std::flush;
 }
 
 void Kitty::draw()
@@ -51,22 +82,28 @@ void Kitty::draw()
 
 void Kitty::generate_frame()
 {
-    const int bits_per_channel = 8;
-    auto chunks = process_chunks();
-    str.append(fmt::format("\033_Ga=T,m=1,i={},q=2,f={},s={},v={};{}\033\\", id, image->channels() * bits_per_channel,
-                           image->width(), image->height(), chunks.front().get_result()));
-
-    for (auto chunk = std::next(std::begin(chunks)); chunk != std::prev(std::end(chunks)); std::advance(chunk, 1)) {
-        str.append("\033_Gm=1,q=2;");
-        str.append(chunk->get_result());
-        str.append("\033\\");
+    // compressing can take a while, other windows keep writing meanwhile
+    std::optional<InlineUpload> upload_inline;
+    if (!key.has_value()) {
+        key = KittyRegistry::make_key(*image);
+        bool upload = false;
+        std::tie(id, upload) = registry->acquire(*key, image->size());
+        if (upload) {
+            upload_inline = transmit();
+        }
     }
-
-    str.append("\033_Gm=0,q=2;");
-    str.append(chunks.back().get_result());
-    str.append("\033\\");
+    str.append(fmt::format("\033_Ga=p,i={},p={},q=2\033\\", id, placement));
 
     const std::scoped_lock lock{*stdout_mutex};
+    if (upload_inline.has_value()) {
+        // written while it is encoded
+        const auto &bytes = upload_inline->bytes;
+        if (bytes.empty()) {
+            transmit_inline(image->data(), image->size(), upload_inline->keys);
+        } else {
+            transmit_inline(bytes.data(), bytes.size(), upload_inline->keys);
+        }
+    }
     util::save_cursor_position();
     util::move_cursor(y, x);
     std::cout << str << std::flush;
@@ -74,33 +111,281 @@ void Kitty::generate_frame()
     str.clear();
 }
 
-auto Kitty::process_chunks() -> std::vector<KittyChunk>
+// uploads the pixels without displaying them. a terminal that answered the
+// medium queries reads them from shared memory or a temporary file, which it
+// deletes afterwards. Returns what has to be sent inline otherwise
+auto Kitty::transmit() -> std::optional<InlineUpload>
+{
+    if (auto png = transmit_png(); png.has_value()) {
+        if (png->bytes.empty()) {
+            // sent as a file
+            return {};
+        }
+        return png;
+    }
+    const auto flags = Flags::instance();
+    if (terminal_is_local() && ((flags->kitty_shm && transmit_shm()) || (flags->kitty_file && transmit_file()))) {
+        return {};
+    }
+#ifdef ENABLE_ZLIB
+    // bytes on the wire are what's slow over ssh and on busy ptys
+    if (!terminal_is_local() || image->size() >= compress_threshold) {
+        auto compressed = compress();
+        if (!compressed.empty()) {
+            return InlineUpload{std::move(compressed), pixel_keys() + ",o=z"};
+        }
+    }
+#endif
+    return InlineUpload{{}, pixel_keys()};
+}
+
+auto Kitty::pixel_keys() const -> std::string
+{
+    const int bits_per_channel = 8;
+    return fmt::format("f={},s={},v={}", image->channels() * bits_per_channel, image->width(), image->height());
+}
+
+// a png holding exactly the displayed pixels is usually much smaller than
+// them, the terminal decodes it itself. images only know such a file if no
+// transform was applied to the pixels while loading. Returns the contents
+// of the file if they have to be sent inline
+auto Kitty::transmit_png() -> std::optional<InlineUpload>
+{
+    const fs::path png = image->identical_file();
+    if (png.empty() || !is_displayed_png(png)) {
+        return {};
+    }
+    std::error_code err;
+    const auto file_size = fs::file_size(png, err);
+    if (err || file_size >= image->size()) {
+        return {};
+    }
+
+    // the terminal only deletes files sent with t=t, the original stays
+    if (terminal_is_local() && Flags::instance()->kitty_file) {
+        const auto &name = png.native();
+        str.append(fmt::format("\033_Ga=t,t=f,f=100,i={},q=2;", id));
+        str.append(util::base64_encode(reinterpret_cast<const unsigned char *>(name.data()), name.size()));
+        str.append("\033\\");
+        return InlineUpload{};
+    }
+    std::ifstream ifs(png, std::ios::binary);
+    std::vector<unsigned char> contents(file_size);
+    if (!ifs.read(reinterpret_cast<char *>(contents.data()), static_cast<std::streamsize>(file_size))) {
+        return {};
+    }
+    return InlineUpload{std::move(contents), "f=100"};
+}
+
+// checks the signature and the size in the IHDR chunk
+auto Kitty::is_displayed_png(const fs::path &path) const -> bool
+{
+    constexpr std::array<unsigned char, 8> signature = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    constexpr size_t header_size = 24;
+    constexpr size_t width_offset = 16;
+    std::array<unsigned char, header_size> header{};
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs.read(reinterpret_cast<char *>(header.data()), header.size())) {
+        return false;
+    }
+    if (!std::equal(std::begin(signature), std::end(signature), std::begin(header))) {
+        return false;
+    }
+    const auto read_u32 = [&header](size_t offset) {
+        const int byte_bits = 8;
+        uint32_t value = 0;
+        for (size_t idx = 0; idx < 4; ++idx) {
+            value = (value << byte_bits) | header.at(offset + idx);
+        }
+        return value;
+    };
+    return read_u32(width_offset) == static_cast<uint32_t>(image->width()) &&
+           read_u32(width_offset + 4) == static_cast<uint32_t>(image->height());
+}
+
+#ifdef ENABLE_ZLIB
+// returns nothing if compressing wouldn't save enough to be worth it. noisy
+// pictures barely compress, a block from the middle of the image tells
+auto Kitty::compress() const -> std::vector<unsigned char>
+{
+    const auto *pixels = image->data();
+    const auto size = image->size();
+    const auto sample = std::min(size, compress_sample);
+    const auto sample_size = zlib::compress(pixels + ((size - sample) / 2), sample).size();
+    const double max_ratio = 0.8;
+    if (static_cast<double>(sample_size) > static_cast<double>(sample) * max_ratio) {
+        return {};
+    }
+    auto compressed = zlib::compress(pixels, size);
+    if (static_cast<double>(compressed.size()) > static_cast<double>(size) * max_ratio) {
+        return {};
+    }
+    return compressed;
+}
+#endif
+
+// ssh sessions and tmux passthrough may reach a terminal on another machine
+auto Kitty::terminal_is_local() -> bool
+{
+    static const bool local = !tmux::is_used() && !os::getenv("SSH_CONNECTION").has_value() &&
+                              !os::getenv("SSH_TTY").has_value();
+    return local;
+}
+
+void Kitty::append_header(std::string_view medium, size_t size)
+{
+    str.append(fmt::format("\033_Ga=t,t={},i={},q=2,{},S={};", medium, id, pixel_keys(), size));
+}
+
+auto Kitty::transmit_shm() -> bool
+{
+    const int name_size = 16;
+    const auto name = fmt::format("/ueberzugpp-{}", util::generate_random_string(name_size));
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        return false;
+    }
+    const bool written = write_pixels(fd);
+    close(fd);
+    if (!written) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+    append_header("s", image->size());
+    str.append(util::base64_encode(reinterpret_cast<const unsigned char *>(name.data()), name.size()));
+    str.append("\033\\");
+    return true;
+}
+
+// the terminal only reads files from temporary directories whose name
+// contains tty-graphics-protocol
+auto Kitty::transmit_file() -> bool
 {
-    const uint64_t chunk_size = 3068;
-    uint64_t num_chunks = image->size() / chunk_size;
-    uint64_t last_chunk_size = image->size() % chunk_size;
-    if (last_chunk_size == 0) {
-        last_chunk_size = chunk_size;
-        num_chunks--;
+    const int name_size = 16;
+    const auto path = std::filesystem::temp_directory_path() /
+                      fmt::format("ueberzugpp-tty-graphics-protocol-{}", util::generate_random_string(name_size));
+    const int fd = open(path.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        return false;
+    }
+    const bool written = write_pixels(fd);
+    close(fd);
+    if (!written) {
+        std::filesystem::remove(path);
+        return false;
+    }
+    const auto &name = path.native();
+    append_header("t", image->size());
+    str.append(util::base64_encode(reinterpret_cast<const unsigned char *>(name.data()), name.size()));
+    str.append("\033\\");
+    return true;
+}
+
+auto Kitty::write_pixels(int fd) -> bool
+{
+    const auto size = image->size();
+    if (ftruncate(fd, static_cast<off_t>(size)) == -1) {
+        return false;
+    }
+    auto *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        return false;
     }
-    const uint64_t bytes_per_chunk = 4 * ((chunk_size + 2) / 3) + 100;
-    str.reserve((num_chunks + 2) * bytes_per_chunk);
+    image->write_to(static_cast<unsigned char *>(ptr));
+    munmap(ptr, size);
+    return true;
+}
 
-    std::vector<KittyChunk> chunks;
-    chunks.reserve(num_chunks + 2);
-    const auto *ptr = image->data();
+// the pixels are base64 encoded a window of chunks at a time, each window is
+// written while the next one is being encoded
+void Kitty::transmit_inline(const unsigned char *pixels, size_t size, std::string_view keys)
+{
+    const auto num_chunks = std::max<uint64_t>((size + chunk_size - 1) / chunk_size, 1);
+    const auto header = fmt::format("\033_Ga=t,m={},i={},q=2,{};", num_chunks > 1 ? 1 : 0, id, keys);
 
-    uint64_t idx = 0;
-    for (; idx < num_chunks; idx++) {
-        chunks.emplace_back(ptr + idx * chunk_size, chunk_size);
+    // every chunk gets a fixed size slot holding its whole escape sequence,
+    // only the last one of the image is shorter
+    constexpr std::string_view more = "\033_Gm=1,q=2;";
+    constexpr std::string_view last = "\033_Gm=0,q=2;";
+    constexpr std::string_view terminator = "\033\\";
+    constexpr uint64_t encoded_size = 4 * ((chunk_size + 2) / 3);
+    constexpr uint64_t slot_size = more.size() + encoded_size + terminator.size();
+    // the encoder terminates its output with a null byte
+    std::array<std::vector<char>, 2> buffers;
+    for (auto &buffer : buffers) {
+        buffer.resize(window_chunks * slot_size + 1);
     }
-    chunks.emplace_back(ptr + idx * chunk_size, last_chunk_size);
 
+    const auto encode = [&](uint64_t window, std::vector<char> &buffer) -> size_t {
+        const auto first = window * window_chunks;
+        const auto end = std::min(first + window_chunks, num_chunks);
+        std::vector<uint64_t> indices(end - first);
+        std::iota(std::begin(indices), std::end(indices), first);
+        const auto encode_chunk = [&](uint64_t chunk) {
+            auto *slot = buffer.data() + ((chunk - first) * slot_size);
+            const auto prefix = chunk + 1 == num_chunks ? last : more;
+            std::copy(std::begin(prefix), std::end(prefix), slot);
+            const auto len = std::min(chunk_size, size - (chunk * chunk_size));
+            util::base64_encode_v2(pixels + (chunk * chunk_size), len,
+                                   reinterpret_cast<unsigned char *>(slot + prefix.size()));
+            std::copy(std::begin(terminator), std::end(terminator), slot + prefix.size() + (4 * ((len + 2) / 3)));
+        };
 #ifdef HAVE_STD_EXECUTION_H
-    std::for_each(std::execution::par_unseq, std::begin(chunks), std::end(chunks), KittyChunk::process_chunk);
+        std::for_each(std::execution::par_unseq, std::begin(indices), std::end(indices), encode_chunk);
 #else
-    oneapi::tbb::parallel_for_each(std::begin(chunks), std::end(chunks), KittyChunk());
+        oneapi::tbb::parallel_for_each(std::begin(indices), std::end(indices), encode_chunk);
 #endif
+        const auto tail = std::min(chunk_size, size - ((end - 1) * chunk_size));
+        return ((end - first - 1) * slot_size) + more.size() + (4 * ((tail + 2) / 3)) + terminator.size();
+    };
+
+    // anything buffered in std::cout has to reach the terminal first
+    std::cout << std::flush;
+    const auto num_windows = (num_chunks + window_chunks - 1) / window_chunks;
+    auto length = encode(0, buffers.front());
+    for (uint64_t window = 0; window < num_windows; ++window) {
+        auto &current = buffers.at(window % buffers.size());
+        std::future<size_t> next;
+        if (window + 1 < num_windows) {
+            next = std::async(std::launch::async, encode, window + 1, std::ref(buffers.at((window + 1) % buffers.size())));
+        }
 
-    return chunks;
+        std::array<iovec, 2> iov{};
+        size_t iovcnt = 0;
+        size_t offset = 0;
+        if (window == 0) {
+            // the first chunk carries the image description instead of m=1
+            iov.at(iovcnt++) = {const_cast<char *>(header.data()), header.size()};
+            offset = more.size();
+        }
+        iov.at(iovcnt++) = {current.data() + offset, length - offset};
+        write_all(std::span{iov.data(), iovcnt});
+
+        if (next.valid()) {
+            length = next.get();
+        }
+    }
+}
+
+// retries partial writes, the terminal may not keep up with large images
+void Kitty::write_all(std::span<iovec> iov)
+{
+    while (!iov.empty()) {
+        const auto written = writev(STDOUT_FILENO, iov.data(), static_cast<int>(iov.size()));
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        auto left = static_cast<size_t>(written);
+        while (!iov.empty() && left >= iov.front().iov_len) {
+            left -= iov.front().iov_len;
+            iov = iov.subspan(1);
+        }
+        if (!iov.empty()) {
+            iov.front().iov_base = static_cast<char *>(iov.front().iov_base) + left;
+            iov.front().iov_len -= left;
+        }
+    }
 }
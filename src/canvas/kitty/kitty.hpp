@@ -17,14 +17,21 @@
 #ifndef KITTY_WINDOW_H
 #define KITTY_WINDOW_H
 
-#include "chunk.hpp"
 #include "image.hpp"
+#include "registry.hpp"
 #include "window.hpp"
 
+#include <filesystem>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 
+#include <sys/uio.h>
+
 class Kitty : public Window
 {
   public:
@@ -35,14 +42,46 @@ class Kitty : public Window
     void generate_frame() override;
 
   private:
+    // bytes of pixels per escape sequence, encodes to the 4096 bytes the
+    // protocol allows
+    static constexpr uint64_t chunk_size = 3072;
+    static constexpr uint64_t window_chunks = 64;
+#ifdef ENABLE_ZLIB
+    static constexpr size_t compress_threshold = 1024 * 1024;
+    static constexpr size_t compress_sample = 256 * 1024;
+
+    [[nodiscard]] auto compress() const -> std::vector<unsigned char>;
+#endif
+
+    // bytes to send inline, prepared before taking the stdout lock
+    struct InlineUpload {
+        // empty sends the pixels of the image
+        std::vector<unsigned char> bytes;
+        std::string keys;
+    };
+
     std::string str;
     std::unique_ptr<Image> image;
     std::mutex *stdout_mutex;
-    uint32_t id;
+    std::shared_ptr<KittyRegistry> registry;
+    // the image data may be shared with other windows, the placement is ours
+    std::optional<KittyImageKey> key;
+    uint32_t id = 0;
+    uint32_t placement;
     int x;
     int y;
 
-    auto process_chunks() -> std::vector<KittyChunk>;
+    auto transmit() -> std::optional<InlineUpload>;
+    void transmit_inline(const unsigned char *pixels, size_t size, std::string_view keys);
+    auto transmit_png() -> std::optional<InlineUpload>;
+    [[nodiscard]] auto is_displayed_png(const std::filesystem::path &path) const -> bool;
+    [[nodiscard]] auto pixel_keys() const -> std::string;
+    auto transmit_shm() -> bool;
+    auto transmit_file() -> bool;
+    auto write_pixels(int fd) -> bool;
+    void append_header(std::string_view medium, size_t size);
+    [[nodiscard]] static auto terminal_is_local() -> bool;
+    static void write_all(std::span<iovec> iov);
 };
 
 #endif
@@ -0,0 +1,87 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "registry.hpp"
+#include "util.hpp"
+
+#include <string_view>
+
+// kitty keeps up to 320MB of image data, stay well under it
+constexpr size_t max_released_bytes = 128 * 1024 * 1024;
+
+auto KittyImageKeyHash::operator()(const KittyImageKey &key) const -> size_t
+{
+    return std::hash<std::string>{}(key.digest) ^ (std::hash<int>{}(key.width) << 1) ^ (std::hash<int>{}(key.height) << 2) ^
+           (std::hash<int>{}(key.channels) << 3);
+}
+
+KittyRegistry::KittyRegistry()
+    : released(max_released_bytes)
+{
+    logger = spdlog::get("kitty");
+}
+
+auto KittyRegistry::make_key(const Image &image) -> KittyImageKey
+{
+    const std::string_view pixels{reinterpret_cast<const char *>(image.data()), image.size()};
+    return {util::get_b2_hash_ssl(pixels), image.width(), image.height(), image.channels()};
+}
+
+auto KittyRegistry::acquire(const KittyImageKey &key, size_t size) -> std::pair<uint32_t, bool>
+{
+    const std::scoped_lock lock{registry_mutex};
+    if (const auto entry = placed.find(key); entry != placed.end()) {
+        ++hits;
+        entry->second.placements += 1;
+        return {entry->second.id, false};
+    }
+    if (const auto entry = released.get(key); entry.has_value()) {
+        ++hits;
+        released.erase(key);
+        placed.emplace(key, Placed{entry->id, entry->size, 1});
+        logger->debug("Reusing uploaded image {} (hits: {}, misses: {})", entry->id, hits, misses);
+        return {entry->id, false};
+    }
+    ++misses;
+    const auto id = util::generate_random_number<uint32_t>(1);
+    placed.emplace(key, Placed{id, size, 1});
+    return {id, true};
+}
+
+auto KittyRegistry::release(const KittyImageKey &key) -> std::vector<uint32_t>
+{
+    const std::scoped_lock lock{registry_mutex};
+    std::vector<uint32_t> evicted;
+    const auto entry = placed.find(key);
+    if (entry == placed.end()) {
+        return evicted;
+    }
+    auto &image = entry->second;
+    image.placements -= 1;
+    if (image.placements > 0) {
+        return evicted;
+    }
+    const Released unused{image.id, image.size};
+    placed.erase(entry);
+
+    while (released.size() > 0 && released.cost() + unused.size > max_released_bytes) {
+        evicted.push_back(released.pop()->second.id);
+    }
+    if (!released.insert(key, unused, unused.size)) {
+        evicted.push_back(unused.id);
+    }
+    return evicted;
+}
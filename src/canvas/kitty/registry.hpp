@@ -0,0 +1,93 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef KITTY_REGISTRY_H
+#define KITTY_REGISTRY_H
+
+#include "image.hpp"
+#include "util/lru.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+struct KittyImageKey {
+    // blake2b of the pixels, a collision would place the wrong upload
+    std::string digest;
+    int width;
+    int height;
+    int channels;
+
+    auto operator==(const KittyImageKey &other) const -> bool = default;
+};
+
+struct KittyImageKeyHash {
+    auto operator()(const KittyImageKey &key) const -> size_t;
+};
+
+// Images uploaded to the terminal during this process. The terminal keeps
+// image data around after its placements are deleted, so an image that is
+// shown again only needs a new placement. Images that are no longer placed
+// anywhere are freed in least recently used order.
+class KittyRegistry
+{
+  public:
+    static auto instance() -> std::shared_ptr<KittyRegistry>
+    {
+        static std::shared_ptr<KittyRegistry> instance{new KittyRegistry};
+        return instance;
+    }
+
+    KittyRegistry(const KittyRegistry &) = delete;
+    auto operator=(const KittyRegistry &) -> KittyRegistry & = delete;
+
+    [[nodiscard]] static auto make_key(const Image &image) -> KittyImageKey;
+
+    // returns the id of the image and whether its data has to be transmitted
+    auto acquire(const KittyImageKey &key, size_t size) -> std::pair<uint32_t, bool>;
+    // drops a placement, returns the ids the terminal should free
+    auto release(const KittyImageKey &key) -> std::vector<uint32_t>;
+
+  private:
+    KittyRegistry();
+
+    struct Placed {
+        uint32_t id;
+        size_t size;
+        int placements;
+    };
+
+    struct Released {
+        uint32_t id;
+        size_t size;
+    };
+
+    std::mutex registry_mutex;
+    std::unordered_map<KittyImageKey, Placed, KittyImageKeyHash> placed;
+    LruCache<KittyImageKey, Released, KittyImageKeyHash> released;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    std::shared_ptr<spdlog::logger> logger;
+};
+
+#endif
@@ -15,14 +15,24 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "sixel.hpp"
+#include "../cache/payload.hpp"
 #include "dimensions.hpp"
 #include "terminal.hpp"
 #include "util.hpp"
 
-#include <filesystem>
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <array>
 #include <iostream>
+#include <numeric>
+#include <optional>
 
-namespace fs = std::filesystem;
+#ifdef HAVE_STD_EXECUTION_H
+#  include <execution>
+#else
+#  include <oneapi/tbb.h>
+#endif
 
 Sixel::Sixel(std::unique_ptr<Image> new_image, std::mutex *stdout_mutex)
     : image(std::move(new_image)),
@@ -34,31 +44,29 @@ Sixel::Sixel(std::unique_ptr<Image> new_image, std::mutex *stdout_mutex)
     horizontal_cells = std::ceil(static_cast<double>(image->width()) / dims.terminal->font_width);
     vertical_cells = std::ceil(static_cast<double>(image->height()) / dims.terminal->font_height);
 
-    const auto draw_callback = [](char *data, int size, void *priv) -> int {
-        auto *str = static_cast<std::string *>(priv);
-        str->append(data, size);
-        return size;
-    };
-    sixel_output_new(&output, draw_callback, &str, nullptr);
-
-    const auto file_size = fs::file_size(image->filename());
-    constexpr auto reserve_ratio = 50;
-    str.reserve(file_size * reserve_ratio);
-
-    // create dither and palette from image
-    sixel_dither_new(&dither, -1, nullptr);
+    // create dither and palette from image, later frames of an animation
+    // are mapped to the same palette
+    sixel_allocator_new(&allocator, nullptr, nullptr, nullptr, nullptr);
+    sixel_dither_new(&dither, -1, allocator);
     sixel_dither_initialize(dither, const_cast<unsigned char *>(image->data()), image->width(), image->height(),
                             SIXEL_PIXELFORMAT_RGB888, SIXEL_LARGE_LUM, SIXEL_REP_CENTER_BOX, SIXEL_QUALITY_HIGH);
+
+    // P2=1 leaves the padding rows of the last band untouched
+    header = fmt::format("\033P0;1;0q\"1;1;{};{}", image->width(), image->height());
+    const auto *palette = sixel_dither_get_palette(dither);
+    const int num_colors = sixel_dither_get_num_of_palette_colors(dither);
+    const auto percent = [](unsigned char value) { return (value * 100 + 127) / 255; };
+    for (int color = 0; color < num_colors; ++color) {
+        const auto *rgb = palette + (color * 3);
+        header.append(fmt::format("#{};2;{};{};{}", color, percent(rgb[0]), percent(rgb[1]), percent(rgb[2])));
+    }
 }
 
 Sixel::~Sixel()
 {
-    can_draw.store(false);
-    if (draw_thread.joinable()) {
-        draw_thread.join();
-    }
+    animation.reset();
     sixel_dither_destroy(dither);
-    sixel_output_destroy(output);
+    sixel_allocator_unref(allocator);
 
     const std::scoped_lock lock{*stdout_mutex};
     util::clear_terminal_area(x, y, horizontal_cells, vertical_cells);
@@ -66,31 +74,189 @@ Sixel::~Sixel()
 
 void Sixel::draw()
 {
+    generate_frame();
     if (!image->is_animated()) {
-        generate_frame();
         return;
     }
 
-    // start drawing loop
-    draw_thread = std::thread([this] {
-        while (can_draw.load()) {
+    // every frame is encoded whole, skipped frames need no bookkeeping
+    animation = AnimationScheduler::instance()->add(image->frame_delay(), [this](bool present) {
+        image->next_frame();
+        if (present) {
             generate_frame();
-            image->next_frame();
-            std::this_thread::sleep_for(std::chrono::milliseconds(image->frame_delay()));
         }
+        return image->frame_delay();
     });
 }
 
+// the terminal drops sixels that scroll away or belong to another tmux
+// window, so the current frame is written again
+void Sixel::show()
+{
+    if (visible) {
+        return;
+    }
+    visible = true;
+    generate_frame();
+    animation.resume();
+}
+
+// nothing gets decoded or encoded until the image is shown again
+void Sixel::hide()
+{
+    if (!visible) {
+        return;
+    }
+    visible = false;
+    animation.pause();
+}
+
+// frames that come back on every loop of an animation are encoded once,
+// later loops and redraws write the cached sequence
 void Sixel::generate_frame()
 {
-    // output sixel content to stream
-    sixel_encode(const_cast<unsigned char *>(image->data()), image->width(), image->height(), 3 /*unused*/, dither,
-                 output);
+    const int frame = image->frame_index();
+    if (frame >= 0 && static_cast<size_t>(frame) < frames.size() && !frames.at(frame).empty()) {
+        write(frames.at(frame));
+        return;
+    }
+    // still images are shared with later previews of the same file
+    const auto payload_cache = PayloadCache::instance();
+    std::optional<PayloadKey> key;
+    if (!image->is_animated()) {
+        key = payload_cache->make_key(*image, "sixel");
+    }
+    if (key.has_value()) {
+        if (const auto payload = payload_cache->get(key.value())) {
+            write(*payload);
+            return;
+        }
+    }
+
+    // dithering writes to the pixels it is given, images may share theirs
+    // with the frame cache or reuse them on every loop
+    scratch.resize(image->size());
+    image->write_to(scratch.data());
+    auto *indexed = sixel_dither_apply_palette(dither, scratch.data(), image->width(), image->height());
+    if (indexed == nullptr) {
+        return;
+    }
+    auto sixels = encode(indexed);
+    sixel_allocator_free(allocator, indexed);
+    write(sixels);
 
+    if (key.has_value()) {
+        payload_cache->insert(key.value(), std::move(sixels));
+        return;
+    }
+    if (frame < 0 || cached_bytes + sixels.size() > cache_budget) {
+        return;
+    }
+    if (static_cast<size_t>(frame) >= frames.size()) {
+        frames.resize(frame + 1);
+    }
+    cached_bytes += sixels.size();
+    frames.at(frame) = std::move(sixels);
+}
+
+void Sixel::write(std::string_view sixels) const
+{
     const std::scoped_lock lock{*stdout_mutex};
     util::save_cursor_position();
     util::move_cursor(y, x);
-    std::cout << str << std::flush;
+    std::cout << sixels << std::flush;
     util::restore_cursor_position();
-    str.clear();
+}
+
+// bands don't depend on each other once the pixels are mapped to the
+// palette, they are encoded in parallel and joined in order
+auto Sixel::encode(const unsigned char *indexed) const -> std::string
+{
+    const int num_bands = (image->height() + band_height - 1) / band_height;
+    std::vector<std::string> bands(num_bands);
+    std::vector<int> indices(num_bands);
+    std::iota(std::begin(indices), std::end(indices), 0);
+    const auto encode_one = [this, indexed, &bands](int band) { bands.at(band) = encode_band(indexed, band); };
+#ifdef HAVE_STD_EXECUTION_H
+    std::for_each(std::execution::par_unseq, std::begin(indices), std::end(indices), encode_one);
+#else
+    oneapi::tbb::parallel_for_each(std::begin(indices), std::end(indices), encode_one);
+#endif
+
+    const std::string_view terminator = "\033\\";
+    const auto length = std::accumulate(std::begin(bands), std::end(bands), header.size() + terminator.size(),
+                                        [](size_t sum, const std::string &band) { return sum + band.size() + 1; });
+    std::string result;
+    result.reserve(length);
+    result.append(header);
+    for (const auto &band : bands) {
+        result.append(band);
+        result.push_back('-');
+    }
+    if (!bands.empty()) {
+        result.pop_back();
+    }
+    result.append(terminator);
+    return result;
+}
+
+// every color used in the band gets one line of sixels, lines go back to
+// the start of the band with $
+auto Sixel::encode_band(const unsigned char *indexed, int band) const -> std::string
+{
+    constexpr int max_colors = 256;
+    constexpr int min_repeat = 4;
+    constexpr char sixel_offset = '?';
+    const int width = image->width();
+    const int top = band * band_height;
+    const int rows = std::min(band_height, image->height() - top);
+
+    std::array<int, max_colors> line_of{};
+    line_of.fill(-1);
+    std::vector<unsigned char> colors;
+    std::vector<unsigned char> lines;
+    for (int row = 0; row < rows; ++row) {
+        const auto *pixels = indexed + (static_cast<size_t>(top + row) * width);
+        for (int col = 0; col < width; ++col) {
+            const auto color = pixels[col];
+            auto &line = line_of.at(color);
+            if (line < 0) {
+                line = static_cast<int>(colors.size());
+                colors.push_back(color);
+                lines.resize(lines.size() + width);
+            }
+            lines.at((static_cast<size_t>(line) * width) + col) |= 1U << row;
+        }
+    }
+
+    std::string result;
+    for (size_t line = 0; line < colors.size(); ++line) {
+        if (line > 0) {
+            result.push_back('$');
+        }
+        result.push_back('#');
+        result.append(std::to_string(colors.at(line)));
+
+        const auto *bits = lines.data() + (line * width);
+        int end = width;
+        while (end > 0 && bits[end - 1] == 0) {
+            --end;
+        }
+        for (int col = 0; col < end;) {
+            int run = 1;
+            while (col + run < end && bits[col + run] == bits[col]) {
+                ++run;
+            }
+            const auto sixel = static_cast<char>(sixel_offset + bits[col]);
+            if (run >= min_repeat) {
+                result.push_back('!');
+                result.append(std::to_string(run));
+                result.push_back(sixel);
+            } else {
+                result.append(run, sixel);
+            }
+            col += run;
+        }
+    }
+    return result;
 }
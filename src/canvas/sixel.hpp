@@ -18,12 +18,13 @@
 #define SIXEL_WINDOW_H
 
 #include "image.hpp"
+#include "util/scheduler.hpp"
 #include "window.hpp"
 
-#include <atomic>
 #include <memory>
 #include <mutex>
-#include <thread>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include <sixel.h>
@@ -36,22 +37,38 @@ class Sixel : public Window
 
     void draw() override;
     void generate_frame() override;
+    void show() override;
+    void hide() override;
 
   private:
+    // a sixel covers six rows of pixels, every band of them is encoded on
+    // its own
+    static constexpr int band_height = 6;
+    static constexpr size_t cache_budget = 64 * 1024 * 1024;
+
     std::unique_ptr<Image> image;
     std::mutex *stdout_mutex;
 
-    std::string str;
-    std::thread draw_thread;
-    std::atomic<bool> can_draw{true};
+    // start of the sequence with the palette, shared by every frame
+    std::string header;
+    // encoded frames by their frame index
+    std::vector<std::string> frames;
+    size_t cached_bytes = 0;
+    std::vector<unsigned char> scratch;
+    AnimationScheduler::Handle animation;
+    bool visible = true;
 
     int x;
     int y;
     int horizontal_cells = 0;
     int vertical_cells = 0;
 
+    sixel_allocator_t *allocator = nullptr;
     sixel_dither_t *dither = nullptr;
-    sixel_output_t *output = nullptr;
+
+    [[nodiscard]] auto encode(const unsigned char *indexed) const -> std::string;
+    [[nodiscard]] auto encode_band(const unsigned char *indexed, int band) const -> std::string;
+    void write(std::string_view sixels) const;
 };
 
 #endif
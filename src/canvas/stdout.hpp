@@ -55,6 +55,20 @@ class StdoutCanvas : public Canvas
         images.erase(identifier);
     }
 
+    void show() override
+    {
+        for (const auto &[identifier, window] : images) {
+            window->show();
+        }
+    }
+
+    void hide() override
+    {
+        for (const auto &[identifier, window] : images) {
+            window->hide();
+        }
+    }
+
   private:
     std::mutex stdout_mutex;
     std::shared_ptr<spdlog::logger> logger;
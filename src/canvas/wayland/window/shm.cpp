@@ -28,12 +28,16 @@
 #include <cerrno>
 #include <system_error>
 
-WaylandShm::WaylandShm(int width, int height, int scale_factor, struct wl_shm *shm)
+constexpr struct wl_buffer_listener buffer_listener = {.release = WaylandShm::wl_buffer_release};
+
+WaylandShm::WaylandShm(int width, int height, int scale_factor, struct wl_shm *shm, int count)
     : shm(shm),
       width(width),
       height(height),
       stride(width * 4),
-      pool_size(height * stride * scale_factor)
+      buffer_size(height * stride * scale_factor),
+      pool_size(buffer_size * count),
+      buffers(count)
 {
     const int path_size = 32;
     shm_path = fmt::format("/{}", util::generate_random_string(path_size));
@@ -61,7 +65,42 @@ void WaylandShm::create_shm_file()
 void WaylandShm::allocate_pool_buffers()
 {
     const auto pool = c_unique_ptr<struct wl_shm_pool, wl_shm_pool_destroy>{wl_shm_create_pool(shm, fd, pool_size)};
-    buffer = wl_shm_pool_create_buffer(pool.get(), 0, width, height, stride, WL_SHM_FORMAT_ARGB8888);
+    int offset = 0;
+    for (auto &buffer : buffers) {
+        buffer.buffer =
+            wl_shm_pool_create_buffer(pool.get(), offset, width, height, stride, WL_SHM_FORMAT_ARGB8888);
+        buffer.data = pool_data + offset;
+        wl_buffer_add_listener(buffer.buffer, &buffer_listener, &buffer);
+        offset += buffer_size;
+    }
+}
+
+void WaylandShm::wl_buffer_release(void *data, [[maybe_unused]] struct wl_buffer *buffer)
+{
+    auto *released = static_cast<Buffer *>(data);
+    released->busy.store(false, std::memory_order_release);
+}
+
+auto WaylandShm::acquire() -> Buffer *
+{
+    for (auto &buffer : buffers) {
+        if (!buffer.busy.load(std::memory_order_acquire)) {
+            return &buffer;
+        }
+    }
+    return nullptr;
+}
+
+auto WaylandShm::current() -> Buffer *
+{
+    return attached;
+}
+
+void WaylandShm::attach(struct wl_surface *surface, Buffer *buffer)
+{
+    buffer->busy.store(true, std::memory_order_release);
+    attached = buffer;
+    wl_surface_attach(surface, buffer->buffer, 0, 0);
 }
 
 WaylandShm::~WaylandShm()
@@ -69,7 +108,9 @@ WaylandShm::~WaylandShm()
     shm_unlink(shm_path.c_str());
     close(fd);
     munmap(pool_data, pool_size);
-    if (buffer != nullptr) {
-        wl_buffer_destroy(buffer);
+    for (auto &buffer : buffers) {
+        if (buffer.buffer != nullptr) {
+            wl_buffer_destroy(buffer.buffer);
+        }
     }
 }
@@ -17,17 +17,35 @@
 #ifndef WAYLAND_SHM_H
 #define WAYLAND_SHM_H
 
+#include <atomic>
 #include <string>
+#include <vector>
 #include <wayland-client.h>
 
+// All buffers of a window carved out of a single memfd. A buffer can only be
+// written to once the compositor has released it.
 class WaylandShm
 {
   public:
-    WaylandShm(int width, int height, int scale_factor, struct wl_shm *shm);
+    struct Buffer {
+        struct wl_buffer *buffer = nullptr;
+        uint8_t *data = nullptr;
+        std::atomic<bool> busy{false};
+    };
+
+    WaylandShm(int width, int height, int scale_factor, struct wl_shm *shm, int count = 1);
     ~WaylandShm();
 
-    struct wl_buffer *buffer = nullptr;
-    uint8_t *pool_data;
+    WaylandShm(const WaylandShm &) = delete;
+    auto operator=(const WaylandShm &) -> WaylandShm & = delete;
+
+    static void wl_buffer_release(void *data, struct wl_buffer *buffer);
+
+    // returns nullptr if the compositor still holds every buffer
+    [[nodiscard]] auto acquire() -> Buffer *;
+    // the buffer most recently attached, its contents are on screen
+    [[nodiscard]] auto current() -> Buffer *;
+    void attach(struct wl_surface *surface, Buffer *buffer);
 
   private:
     void create_shm_file();
@@ -37,11 +55,16 @@ class WaylandShm
 
     int fd = 0;
     std::string shm_path;
+    uint8_t *pool_data = nullptr;
 
     int width = 0;
     int height = 0;
     int stride = 0;
+    int buffer_size = 0;
     int pool_size = 0;
+
+    std::vector<Buffer> buffers;
+    Buffer *attached = nullptr;
 };
 
 #endif
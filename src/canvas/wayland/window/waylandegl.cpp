@@ -19,7 +19,6 @@
 #include "util.hpp"
 
 #include <fmt/format.h>
-#include <thread>
 
 constexpr int id_len = 10;
 
@@ -52,6 +51,7 @@ WaylandEglWindow::WaylandEglWindow(struct wl_compositor *compositor, struct xdg_
 
 WaylandEglWindow::~WaylandEglWindow()
 {
+    animation.reset();
     opengl_cleanup();
     delete_xdg_structs();
     delete_wayland_structs();
@@ -101,9 +101,9 @@ void WaylandEglWindow::setup_listeners()
     xdg_surface_add_listener(xdg_surface, &xdg_surface_listener_egl, this_ptr);
     wl_surface_commit(surface);
 
-    if (image->is_animated()) {
-        callback = wl_surface_frame(surface);
-        wl_callback_add_listener(callback, &frame_listener_egl, this_ptr);
+    if (image->is_animated() && !animation) {
+        animation =
+            AnimationScheduler::instance()->add(image->frame_delay(), [this](bool present) { return step(present); });
     }
 }
 
@@ -139,10 +139,13 @@ void WaylandEglWindow::delete_wayland_structs()
 
 void WaylandEglWindow::draw()
 {
+    const std::scoped_lock lock{draw_mutex};
     load_framebuffer();
 
     wl_surface_commit(surface);
     move_window();
+    // a frame callback pending while hidden may never be answered
+    frame_ready.store(true);
 }
 
 void WaylandEglWindow::load_framebuffer()
@@ -170,13 +173,24 @@ void WaylandEglWindow::move_window()
     config->move_window(appid, xcoord, ycoord);
 }
 
+auto WaylandEglWindow::step(bool present) -> int
+{
+    const std::scoped_lock lock{draw_mutex};
+    image->next_frame();
+    // the compositor hasn't shown the previous frame yet, skip this one
+    if (present && visible && frame_ready.load()) {
+        generate_frame();
+    }
+    return image->frame_delay();
+}
+
+// draws the current frame of the image
 void WaylandEglWindow::generate_frame()
 {
-    std::this_thread::sleep_for(std::chrono::milliseconds(image->frame_delay()));
+    frame_ready.store(false);
     callback = wl_surface_frame(surface);
     wl_callback_add_listener(callback, &frame_listener_egl, this_ptr);
 
-    image->next_frame();
     load_framebuffer();
 
     wl_surface_commit(surface);
@@ -192,6 +206,7 @@ void WaylandEglWindow::show()
     xdg_toplevel = xdg_surface_get_toplevel(xdg_surface);
     xdg_setup();
     setup_listeners();
+    animation.resume();
 }
 
 void WaylandEglWindow::hide()
@@ -200,7 +215,10 @@ void WaylandEglWindow::hide()
         return;
     }
     visible = false;
+    animation.pause();
     const std::scoped_lock lock{draw_mutex};
+    // nothing is drawn until the surface is configured again
+    frame_ready.store(false);
     delete_xdg_structs();
     wl_surface_attach(surface, nullptr, 0, 0);
     wl_surface_commit(surface);
@@ -226,10 +244,7 @@ void WaylandEglWindow::wl_surface_frame_done(void *data, struct wl_callback *cal
     if (!window) {
         return;
     }
+    // frames are drawn by the animation scheduler, never on the dispatch thread
     auto *egl_window = dynamic_cast<WaylandEglWindow *>(window.get());
-    const std::scoped_lock lock{egl_window->draw_mutex};
-    if (!egl_window->visible) {
-        return;
-    }
-    egl_window->generate_frame();
+    egl_window->frame_ready.store(true);
 }
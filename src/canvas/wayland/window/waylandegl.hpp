@@ -20,12 +20,14 @@
 #include "../config.hpp"
 #include "image.hpp"
 #include "util/egl.hpp"
+#include "util/scheduler.hpp"
 #include "wayland-xdg-shell-client-protocol.h"
 #include "waylandwindow.hpp"
 
 #include <wayland-client.h>
 #include <wayland-egl.h>
 
+#include <atomic>
 #include <memory>
 #include <mutex>
 
@@ -70,10 +72,15 @@ class WaylandEglWindow : public WaylandWindow
     std::mutex draw_mutex;
     std::mutex egl_mutex;
 
+    // set once the surface is configured and whenever the compositor
+    // wants a new frame
+    std::atomic<bool> frame_ready{false};
+    AnimationScheduler::Handle animation;
+
     std::string appid;
     void *this_ptr;
     struct XdgStructAgg *xdg_agg;
-    bool visible = false;
+    std::atomic<bool> visible{false};
 
     void move_window();
     void delete_wayland_structs();
@@ -82,6 +89,7 @@ class WaylandEglWindow : public WaylandWindow
     void opengl_cleanup();
     void xdg_setup();
     void setup_listeners();
+    auto step(bool present) -> int;
     void opengl_setup();
     void load_framebuffer();
 };
@@ -49,17 +49,15 @@ void WaylandShmWindow::wl_surface_frame_done(void *data, struct wl_callback *cal
     if (!window) {
         return;
     }
+    // frames are drawn by the animation scheduler, never on the dispatch thread
     auto *shm_window = dynamic_cast<WaylandShmWindow *>(window.get());
-    const std::scoped_lock lock{shm_window->draw_mutex};
-    if (!shm_window->visible) {
-        return;
-    }
-    shm_window->generate_frame();
+    shm_window->frame_ready.store(true);
 }
 
 WaylandShmWindow::WaylandShmWindow(WaylandCanvas *canvas, std::unique_ptr<Image> new_image,
                                    struct XdgStructAgg *xdg_agg, WaylandConfig *config)
     : config(config),
+      display(canvas->display),
       xdg_base(canvas->xdg_base),
       surface(wl_compositor_create_surface(canvas->compositor)),
       xdg_surface(xdg_wm_base_get_xdg_surface(xdg_base, surface)),
@@ -71,7 +69,9 @@ WaylandShmWindow::WaylandShmWindow(WaylandCanvas *canvas, std::unique_ptr<Image>
     config->initial_setup(appid);
     xdg_setup();
     output_scale = canvas->output_info.at(config->get_focused_output_name());
-    shm = std::make_unique<WaylandShm>(image->width(), image->height(), output_scale, canvas->wl_shm);
+    // animations keep drawing while the compositor reads the previous frames
+    const int buffers = image->is_animated() ? 3 : 1;
+    shm = std::make_unique<WaylandShm>(image->width(), image->height(), output_scale, canvas->wl_shm, buffers);
 }
 
 void WaylandShmWindow::finish_init()
@@ -90,9 +90,9 @@ void WaylandShmWindow::setup_listeners()
     xdg_surface_add_listener(xdg_surface, &xdg_surface_listener, this_ptr);
     wl_surface_commit(surface);
 
-    if (image->is_animated()) {
-        callback = wl_surface_frame(surface);
-        wl_callback_add_listener(callback, &frame_listener, this_ptr);
+    if (image->is_animated() && !animation) {
+        animation =
+            AnimationScheduler::instance()->add(image->frame_delay(), [this](bool present) { return step(present); });
     }
 }
 
@@ -104,17 +104,27 @@ void WaylandShmWindow::xdg_setup()
 
 WaylandShmWindow::~WaylandShmWindow()
 {
+    animation.reset();
     delete_xdg_structs();
     delete_wayland_structs();
 }
 
 void WaylandShmWindow::wl_draw(int32_t scale_factor)
 {
-    std::memcpy(shm->pool_data, image->data(), image->size());
-    wl_surface_attach(surface, shm->buffer, 0, 0);
+    const std::scoped_lock lock{draw_mutex};
+    // with every buffer busy, the last one attached already shows the current frame
+    auto *buffer = shm->acquire();
+    if (buffer != nullptr) {
+        image->write_to(buffer->data);
+    } else {
+        buffer = shm->current();
+    }
+    shm->attach(surface, buffer);
     wl_surface_set_buffer_scale(surface, scale_factor);
     wl_surface_commit(surface);
     move_window();
+    // a frame callback pending while hidden may never be answered
+    frame_ready.store(true);
 }
 
 void WaylandShmWindow::show()
@@ -127,6 +137,7 @@ void WaylandShmWindow::show()
     xdg_toplevel = xdg_surface_get_toplevel(xdg_surface);
     xdg_setup();
     setup_listeners();
+    animation.resume();
 }
 
 void WaylandShmWindow::hide()
@@ -135,7 +146,10 @@ void WaylandShmWindow::hide()
         return;
     }
     visible = false;
+    animation.pause();
     const std::scoped_lock lock{draw_mutex};
+    // nothing is drawn until the surface is configured again
+    frame_ready.store(false);
     delete_xdg_structs();
     wl_surface_attach(surface, nullptr, 0, 0);
     wl_surface_commit(surface);
@@ -172,15 +186,47 @@ void WaylandShmWindow::move_window()
     config->move_window(appid, xcoord, ycoord);
 }
 
+auto WaylandShmWindow::step(bool present) -> int
+{
+    const std::scoped_lock lock{draw_mutex};
+    image->next_frame();
+    // the compositor hasn't shown the previous frame yet, skip this one
+    if (!present || !visible || !frame_ready.load()) {
+        invalidate();
+    } else {
+        generate_frame();
+    }
+    return image->frame_delay();
+}
+
+void WaylandShmWindow::invalidate()
+{
+    invalidated = true;
+}
+
+// draws the current frame of the image
 void WaylandShmWindow::generate_frame()
 {
-    std::this_thread::sleep_for(std::chrono::milliseconds(image->frame_delay()));
+    auto *buffer = shm->acquire();
+    if (buffer == nullptr) {
+        invalidate();
+        return;
+    }
+    const auto rects = invalidated ? damage::full(image->width(), image->height()) : image->damage();
+    if (rects.empty()) {
+        return;
+    }
+    invalidated = false;
+
+    frame_ready.store(false);
     callback = wl_surface_frame(surface);
     wl_callback_add_listener(callback, &frame_listener, this_ptr);
 
-    image->next_frame();
-    std::memcpy(shm->pool_data, image->data(), image->size());
-    wl_surface_attach(surface, shm->buffer, 0, 0);
-    wl_surface_damage_buffer(surface, 0, 0, image->width(), image->height());
+    image->write_to(buffer->data);
+    shm->attach(surface, buffer);
+    for (const auto &rect : rects) {
+        wl_surface_damage_buffer(surface, rect.x, rect.y, rect.width, rect.height);
+    }
     wl_surface_commit(surface);
+    wl_display_flush(display);
 }
@@ -20,6 +20,7 @@
 #include "../wayland.hpp"
 #include "image.hpp"
 #include "shm.hpp"
+#include "util/scheduler.hpp"
 #include "wayland-xdg-shell-client-protocol.h"
 #include "waylandwindow.hpp"
 
@@ -41,6 +42,7 @@ class WaylandShmWindow : public WaylandWindow
     void draw() override {}
     void wl_draw(int32_t scale_factor) override;
     void generate_frame() override;
+    void invalidate() override;
     void show() override;
     void hide() override;
 
@@ -48,12 +50,16 @@ class WaylandShmWindow : public WaylandWindow
 
     std::mutex draw_mutex;
     std::atomic<bool> visible{false};
+    // set once the surface is configured and whenever the compositor
+    // wants a new frame
+    std::atomic<bool> frame_ready{false};
     std::unique_ptr<WaylandShm> shm;
     int32_t output_scale;
 
   private:
     WaylandConfig *config;
 
+    struct wl_display *display = nullptr;
     struct xdg_wm_base *xdg_base = nullptr;
     struct wl_surface *surface = nullptr;
     struct xdg_surface *xdg_surface = nullptr;
@@ -62,6 +68,8 @@ class WaylandShmWindow : public WaylandWindow
 
     std::unique_ptr<Image> image;
     std::string appid;
+    AnimationScheduler::Handle animation;
+    bool invalidated = false;
 
     struct XdgStructAgg *xdg_agg;
     void *this_ptr;
@@ -70,6 +78,7 @@ class WaylandShmWindow : public WaylandWindow
     void xdg_setup();
 
     void setup_listeners();
+    auto step(bool present) -> int;
     void delete_wayland_structs();
     void delete_xdg_structs();
 };
@@ -19,17 +19,20 @@
 
 #include <string_view>
 
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <xcb/xcb.h>
 
 constexpr std::string_view win_name = "ueberzugpp";
 
 X11Window::X11Window(xcb_connection_t *connection, xcb_screen_t *screen, xcb_window_t window, xcb_window_t parent,
-                     std::shared_ptr<Image> image)
+                     std::shared_ptr<Image> image, bool use_shm)
     : connection(connection),
       screen(screen),
       window(window),
       parent(parent),
       gc(xcb_generate_id(connection)),
+      use_shm(use_shm),
       image(std::move(image))
 {
     logger = spdlog::get("X11");
@@ -53,7 +56,9 @@ void X11Window::create()
                           image->height(), 0, XCB_WINDOW_CLASS_INPUT_OUTPUT, screen->root_visual, value_mask,
                           &value_list);
 
-    xcb_create_gc(connection, gc, window, 0, nullptr);
+    // copies from the pixmap never need NoExpose events
+    const uint32_t graphics_exposures = 0;
+    xcb_create_gc(connection, gc, window, XCB_GC_GRAPHICS_EXPOSURES, &graphics_exposures);
     logger->debug("Created child window {} at ({},{}) with parent {}", window, xcoord, ycoord, parent);
 }
 
@@ -86,34 +91,176 @@ void X11Window::hide()
 
 void X11Window::draw()
 {
-    if (!xcb_image) {
+    draw_area(0, 0, image->width(), image->height());
+}
+
+// exposes are served from the server side copy of the image
+void X11Window::draw_area(int xcoord, int ycoord, int width, int height)
+{
+    if (pixmap == 0) {
         return;
     }
-    xcb_image_put(connection, window, gc, xcb_image.get(), 0, 0, 0);
+    const auto src_x = static_cast<int16_t>(xcoord);
+    const auto src_y = static_cast<int16_t>(ycoord);
+    xcb_copy_area(connection, pixmap, window, gc, src_x, src_y, src_x, src_y, static_cast<uint16_t>(width),
+                  static_cast<uint16_t>(height));
+    xcb_flush(connection);
 }
 
 void X11Window::generate_frame()
 {
-    xcb_image.reset(xcb_image_create_native(connection, image->width(), image->height(), XCB_IMAGE_FORMAT_Z_PIXMAP,
-                                            screen->root_depth, nullptr, 0, nullptr));
-    xcb_image->data = const_cast<unsigned char *>(image->data());
-    send_expose_event();
+    const auto width = static_cast<uint16_t>(image->width());
+    const auto height = static_cast<uint16_t>(image->height());
+    // a new pixmap holds garbage, everything has to be uploaded
+    auto rects = damage::full(width, height);
+    if (pixmap == 0 || pixmap_width != width || pixmap_height != height) {
+        create_pixmap(width, height);
+    } else if (!invalidated) {
+        rects = image->damage();
+    }
+    invalidated = false;
+    if (rects.empty()) {
+        return;
+    }
+
+    if (shm_data != nullptr && image->size() != frame_size) {
+        detach_shm();
+    }
+    if (use_shm && (shm_data != nullptr || attach_shm())) {
+        const size_t half = write_offset == 0 ? 0 : 1;
+        wait_for_half(half);
+        // the server reads rects out of the whole frame, so it is always written entirely
+        image->write_to(shm_data + write_offset);
+        for (const auto &rect : rects) {
+            const auto src_x = static_cast<int16_t>(rect.x);
+            const auto src_y = static_cast<int16_t>(rect.y);
+            xcb_shm_put_image(connection, pixmap, gc, width, height, src_x, src_y, static_cast<uint16_t>(rect.width),
+                              static_cast<uint16_t>(rect.height), src_x, src_y, screen->root_depth,
+                              XCB_IMAGE_FORMAT_Z_PIXMAP, 0, shmseg, write_offset);
+        }
+        // requests are handled in order, the put images are done once this is answered
+        shm_fences.at(half) = xcb_get_input_focus(connection);
+        write_offset = write_offset == 0 ? static_cast<uint32_t>(frame_size) : 0;
+    } else {
+        // animation frames share the same geometry, only the pixels change. The
+        // image doesn't own the pixels, so nothing gets allocated for it
+        auto *data = const_cast<unsigned char *>(image->data());
+        if (!xcb_image || xcb_image->width != width || xcb_image->height != height) {
+            xcb_image.reset(xcb_image_create_native(connection, width, height, XCB_IMAGE_FORMAT_Z_PIXMAP,
+                                                    screen->root_depth, nullptr, image->size(), data));
+        }
+        if (!xcb_image) {
+            return;
+        }
+        xcb_image->data = data;
+        xcb_image_put(connection, pixmap, gc, xcb_image.get(), 0, 0, 0);
+    }
+    for (const auto &rect : rects) {
+        send_expose_event(rect);
+    }
+    xcb_flush(connection);
+}
+
+void X11Window::invalidate()
+{
+    invalidated = true;
+}
+
+void X11Window::create_pixmap(uint16_t width, uint16_t height)
+{
+    if (pixmap != 0) {
+        xcb_free_pixmap(connection, pixmap);
+    }
+    pixmap = xcb_generate_id(connection);
+    xcb_create_pixmap(connection, screen->root_depth, pixmap, window, width, height);
+    pixmap_width = width;
+    pixmap_height = height;
+}
+
+// only works if the server runs on the same machine, the image pipeline then
+// writes frames straight into memory shared with the server
+auto X11Window::attach_shm() -> bool
+{
+    frame_size = image->size();
+    const int shmid = shmget(IPC_PRIVATE, frame_size * 2, IPC_CREAT | 0600);
+    if (shmid == -1) {
+        use_shm = false;
+        return false;
+    }
+    auto *addr = shmat(shmid, nullptr, 0);
+    if (addr == reinterpret_cast<void *>(-1)) {
+        shmctl(shmid, IPC_RMID, nullptr);
+        use_shm = false;
+        return false;
+    }
+
+    shmseg = xcb_generate_id(connection);
+    const auto cookie = xcb_shm_attach_checked(connection, shmseg, shmid, 0);
+    const unique_C_ptr<xcb_generic_error_t> err{xcb_request_check(connection, cookie)};
+    // the segment is destroyed once both sides detach
+    shmctl(shmid, IPC_RMID, nullptr);
+    if (err) {
+        logger->debug("MIT-SHM is not usable, falling back to xcb_image_put");
+        shmdt(addr);
+        use_shm = false;
+        return false;
+    }
+    shm_data = static_cast<unsigned char *>(addr);
+    logger->debug("Attached MIT-SHM segment of {} bytes to window {}", frame_size * 2, window);
+    return true;
+}
+
+void X11Window::wait_for_half(size_t half)
+{
+    auto &fence = shm_fences.at(half);
+    if (!fence.has_value()) {
+        return;
+    }
+    const unique_C_ptr<xcb_get_input_focus_reply_t> reply{
+        xcb_get_input_focus_reply(connection, fence.value(), nullptr)};
+    fence.reset();
+}
+
+void X11Window::detach_shm()
+{
+    if (shm_data == nullptr) {
+        return;
+    }
+    // the server reads the segment through its own mapping
+    for (auto &fence : shm_fences) {
+        if (fence.has_value()) {
+            xcb_discard_reply(connection, fence->sequence);
+            fence.reset();
+        }
+    }
+    xcb_shm_detach(connection, shmseg);
+    shmdt(shm_data);
+    shm_data = nullptr;
+    write_offset = 0;
 }
 
 X11Window::~X11Window()
 {
+    detach_shm();
+    if (pixmap != 0) {
+        xcb_free_pixmap(connection, pixmap);
+    }
     xcb_destroy_window(connection, window);
     xcb_free_gc(connection, gc);
     xcb_flush(connection);
 }
 
-void X11Window::send_expose_event()
+void X11Window::send_expose_event(const damage::Rect &rect)
 {
     const int event_size = 32;
     std::array<char, event_size> buffer;
     auto *event = reinterpret_cast<xcb_expose_event_t *>(buffer.data());
+    buffer.fill(0);
     event->response_type = XCB_EXPOSE;
     event->window = window;
+    event->x = static_cast<uint16_t>(rect.x);
+    event->y = static_cast<uint16_t>(rect.y);
+    event->width = static_cast<uint16_t>(rect.width);
+    event->height = static_cast<uint16_t>(rect.height);
     xcb_send_event(connection, 0, window, XCB_EVENT_MASK_EXPOSURE, reinterpret_cast<char *>(event));
-    xcb_flush(connection);
 }
@@ -21,6 +21,11 @@
 #include "util/ptr.hpp"
 #include "window.hpp"
 
+#include <array>
+#include <cstdint>
+#include <optional>
+
+#include <xcb/shm.h>
 #include <xcb/xcb_image.h>
 #include <spdlog/spdlog.h>
 
@@ -30,11 +35,14 @@ class X11Window : public Window
 {
 public:
     X11Window(xcb_connection_t* connection, xcb_screen_t *screen,
-            xcb_window_t window, xcb_window_t parent, std::shared_ptr<Image> image);
+            xcb_window_t window, xcb_window_t parent, std::shared_ptr<Image> image,
+            bool use_shm = false);
     ~X11Window() override;
 
     void draw() override;
+    void draw_area(int xcoord, int ycoord, int width, int height) override;
     void generate_frame() override;
+    void invalidate() override;
     void show() override;
     void hide() override;
 
@@ -47,12 +55,33 @@ private:
     xcb_gcontext_t gc;
 
     c_unique_ptr<xcb_image_t, xcb_image_destroy> xcb_image;
+
+    // server side copy of the current frame, exposes only copy from it
+    xcb_pixmap_t pixmap = 0;
+    uint16_t pixmap_width = 0;
+    uint16_t pixmap_height = 0;
+
+    // MIT-SHM segment holding two frames, one being written while the
+    // server may still read the other
+    bool use_shm;
+    xcb_shm_seg_t shmseg = 0;
+    unsigned char *shm_data = nullptr;
+    size_t frame_size = 0;
+    uint32_t write_offset = 0;
+    // round trip sent after the last upload from each half, its reply means
+    // the server is done reading that half
+    std::array<std::optional<xcb_get_input_focus_cookie_t>, 2> shm_fences;
     std::shared_ptr<spdlog::logger> logger;
     std::shared_ptr<Image> image;
 
     bool visible = false;
+    bool invalidated = false;
 
-    void send_expose_event();
+    void send_expose_event(const damage::Rect &rect);
+    void create_pixmap(uint16_t width, uint16_t height);
+    auto attach_shm() -> bool;
+    void detach_shm();
+    void wait_for_half(size_t half);
     void create();
     void change_title();
 };
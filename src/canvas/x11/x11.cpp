@@ -24,6 +24,7 @@
 #include <string_view>
 
 #include <range/v3/all.hpp>
+#include <xcb/shm.h>
 
 #ifdef ENABLE_OPENGL
 #  include "window/x11egl.hpp"
@@ -57,6 +58,8 @@ X11Canvas::X11Canvas()
     }
 #endif
 
+    const auto *shm_ext = xcb_get_extension_data(connection, &xcb_shm_id);
+    shm_available = shm_ext != nullptr && shm_ext->present != 0;
     xutil = std::make_unique<X11Util>(connection);
     logger = spdlog::get("X11");
     event_handler = std::thread(&X11Canvas::handle_events, this);
@@ -65,9 +68,12 @@ X11Canvas::X11Canvas()
 
 X11Canvas::~X11Canvas()
 {
-    draw_threads.clear();
-    windows.clear();
-    image_windows.clear();
+    animations.clear();
+    {
+        const std::scoped_lock lock{windows_mutex};
+        windows.clear();
+        image_windows.clear();
+    }
 
     if (event_handler.joinable()) {
         event_handler.join();
@@ -82,36 +88,55 @@ X11Canvas::~X11Canvas()
 
 void X11Canvas::draw(const std::string &identifier)
 {
-    if (!images.at(identifier)->is_animated()) {
-        for (const auto &[wid, window] : image_windows.at(identifier)) {
+    const auto image = images.at(identifier);
+    const auto wins = image_windows.at(identifier);
+    animations.erase(identifier);
+    {
+        const std::scoped_lock lock{windows_mutex};
+        for (const auto &[wid, window] : wins) {
             window->generate_frame();
         }
+    }
+    if (!image->is_animated()) {
         return;
     }
 
-    draw_threads.insert_or_assign(identifier, std::jthread([this, identifier](const std::stop_token &stoken) {
-                                      const auto image = images.at(identifier);
-                                      const auto wins = image_windows.at(identifier);
-                                      while (!stoken.stop_requested()) {
-                                          for (const auto &[wid, window] : wins) {
-                                              window->generate_frame();
-                                          }
-                                          image->next_frame();
-                                          std::this_thread::sleep_for(std::chrono::milliseconds(image->frame_delay()));
-                                      }
-                                  }));
+    // windows replace and fill their pixmaps while exposes copy from them
+    auto step = [this, image, wins](bool present) {
+        image->next_frame();
+        const std::scoped_lock lock{windows_mutex};
+        for (const auto &[wid, window] : wins) {
+            if (present) {
+                window->generate_frame();
+            } else {
+                window->invalidate();
+            }
+        }
+        return image->frame_delay();
+    };
+    animations.insert_or_assign(identifier, AnimationScheduler::instance()->add(image->frame_delay(), step));
 }
 
 void X11Canvas::show()
 {
-    const std::scoped_lock lock{windows_mutex};
-    for (const auto &[wid, window] : windows) {
-        window->show();
+    {
+        const std::scoped_lock lock{windows_mutex};
+        for (const auto &[wid, window] : windows) {
+            window->show();
+        }
+    }
+    for (const auto &[identifier, animation] : animations) {
+        animation.resume();
     }
 }
 
+// unmapped windows keep their pixmaps, animations continue from the frame
+// they stopped at. Pausing waits for a running step, which needs the lock
 void X11Canvas::hide()
 {
+    for (const auto &[identifier, animation] : animations) {
+        animation.pause();
+    }
     const std::scoped_lock lock{windows_mutex};
     for (const auto &[wid, window] : windows) {
         window->hide();
@@ -152,7 +177,7 @@ void X11Canvas::handle_events()
                     try {
                         logger->debug("Received expose event for window {}", expose->window);
                         const auto window = windows.at(expose->window);
-                        window->draw();
+                        window->draw_area(expose->x, expose->y, expose->width, expose->height);
                     } catch (const std::out_of_range &oor) {
                         logger->debug("Discarding expose event for window {}", expose->window);
                     }
@@ -194,8 +219,9 @@ void X11Canvas::add_image(const std::string &identifier, std::unique_ptr<Image>
         }
 #endif
         if (window == nullptr) {
-            window = std::make_shared<X11Window>(connection, screen, window_id, parent, image);
+            window = std::make_shared<X11Window>(connection, screen, window_id, parent, image, shm_available);
         }
+        const std::scoped_lock lock{windows_mutex};
         windows.insert({window_id, window});
         image_windows.at(identifier).insert({window_id, window});
         window->show();
@@ -243,7 +269,7 @@ void X11Canvas::print_xcb_error(const xcb_generic_error_t *err)
 
 void X11Canvas::remove_image(const std::string &identifier)
 {
-    draw_threads.erase(identifier);
+    animations.erase(identifier);
     images.erase(identifier);
 
     const std::scoped_lock lock{windows_mutex};
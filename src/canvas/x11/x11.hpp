@@ -21,6 +21,7 @@
 #include "image.hpp"
 #include "window.hpp"
 #include "dimensions.hpp"
+#include "util/scheduler.hpp"
 #include "util/x11.hpp"
 
 #include <memory>
@@ -71,7 +72,7 @@ private:
         std::unordered_map<xcb_window_t, std::shared_ptr<Window>>> image_windows;
 
     std::unordered_map<std::string, std::shared_ptr<Image>> images;
-    std::unordered_map<std::string, std::jthread> draw_threads;
+    std::unordered_map<std::string, AnimationScheduler::Handle> animations;
 
     std::thread event_handler;
     std::mutex windows_mutex;
@@ -79,6 +80,8 @@ private:
     std::shared_ptr<spdlog::logger> logger;
     std::shared_ptr<Flags> flags;
 
+    bool shm_available = false;
+
 #ifdef ENABLE_OPENGL
     std::unique_ptr<EGLUtil<xcb_connection_t, xcb_window_t>> egl;
     bool egl_available = true;
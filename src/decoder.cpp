@@ -0,0 +1,152 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "decoder.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+using njson = nlohmann::json;
+
+Decoder::Decoder(const Terminal *terminal, callback_t callback)
+    : terminal(terminal),
+      callback(std::move(callback))
+{
+    logger = spdlog::get("main");
+    const unsigned max_workers = 4;
+    // always leave a thread free for add commands, even on a single core
+    const unsigned num_workers = std::clamp(std::thread::hardware_concurrency() / 2, 2U, max_workers);
+    max_prefetches = num_workers - 1;
+    for (unsigned i = 0; i < num_workers; ++i) {
+        workers.emplace_back(&Decoder::worker_loop, this);
+    }
+    logger->debug("Started {} decoder threads", num_workers);
+}
+
+Decoder::~Decoder()
+{
+    {
+        const std::scoped_lock lock{queue_mutex};
+        stop = true;
+    }
+    queue_cv.notify_all();
+    for (auto &worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void Decoder::submit(const std::string &identifier, njson command)
+{
+    {
+        const std::scoped_lock lock{queue_mutex};
+        const auto generation = ++last_generation;
+        generations.insert_or_assign(identifier, generation);
+        const auto [entry, inserted] = pending.insert_or_assign(identifier, Job{std::move(command), generation});
+        if (inserted) {
+            queue.push_back(identifier);
+        } else {
+            logger->debug("Replacing pending image for id {}", identifier);
+        }
+    }
+    queue_cv.notify_one();
+}
+
+void Decoder::cancel(const std::string &identifier)
+{
+    const std::scoped_lock lock{queue_mutex};
+    // jobs in flight find no generation and are discarded
+    generations.erase(identifier);
+    if (pending.erase(identifier) > 0) {
+        std::erase(queue, identifier);
+    }
+}
+
+void Decoder::prefetch(std::vector<njson> commands)
+{
+    {
+        const std::scoped_lock lock{queue_mutex};
+        prefetch_queue.clear();
+        std::move(commands.begin(), commands.end(), std::back_inserter(prefetch_queue));
+    }
+    queue_cv.notify_all();
+}
+
+auto Decoder::can_prefetch() const -> bool
+{
+    return !prefetch_queue.empty() && active_prefetches < max_prefetches;
+}
+
+auto Decoder::is_latest(const std::string &identifier, uint64_t generation) -> bool
+{
+    const std::scoped_lock lock{queue_mutex};
+    const auto entry = generations.find(identifier);
+    return entry != generations.end() && entry->second == generation;
+}
+
+void Decoder::worker_loop()
+{
+    while (true) {
+        std::string identifier;
+        Job job;
+        {
+            std::unique_lock lock{queue_mutex};
+            queue_cv.wait(lock, [this] { return stop || !queue.empty() || can_prefetch(); });
+            if (stop) {
+                return;
+            }
+            if (queue.empty()) {
+                auto command = std::move(prefetch_queue.front());
+                prefetch_queue.pop_front();
+                ++active_prefetches;
+                lock.unlock();
+
+                run_prefetch(command);
+
+                lock.lock();
+                --active_prefetches;
+                continue;
+            }
+            identifier = std::move(queue.front());
+            queue.pop_front();
+            auto node = pending.extract(identifier);
+            job = std::move(node.mapped());
+        }
+
+        std::unique_ptr<Image> image;
+        try {
+            image = Image::load(job.command, terminal);
+        } catch (const std::exception &ex) {
+            logger->error("Unable to load image file: {}", ex.what());
+            continue;
+        }
+        if (!image) {
+            logger->error("Unable to load image file");
+            continue;
+        }
+        callback(identifier, job.generation, std::move(image));
+    }
+}
+
+void Decoder::run_prefetch(const njson &command)
+{
+    try {
+        Image::prefetch(command, terminal);
+    } catch (const std::exception &ex) {
+        logger->debug("Unable to prefetch image: {}", ex.what());
+    }
+}
@@ -49,4 +49,11 @@ void Flags::read_config_file()
     no_cache = layer.value("no-cache", false);
     no_opencv = layer.value("no-opencv", false);
     use_opengl = layer.value("opengl", false);
+    frame_cache_size = layer.value("frame-cache-size", frame_cache_size);
+    animation_cache_size = layer.value("animation-cache-size", animation_cache_size);
+    payload_cache_size = layer.value("payload-cache-size", payload_cache_size);
+    payload_cache_disk = layer.value("payload-cache-disk", payload_cache_disk);
+    cache_max_size = layer.value("cache-max-size", cache_max_size);
+    cache_max_age = layer.value("cache-max-age", cache_max_age);
+    cache_format = layer.value("cache-format", cache_format);
 }
@@ -17,15 +17,21 @@
 #include "image.hpp"
 #ifdef ENABLE_OPENCV
 #  include "image/opencv.hpp"
+#  include "image/video.hpp"
 #endif
+#include "cache/disk.hpp"
+#include "cache/frame.hpp"
 #include "dimensions.hpp"
 #include "flags.hpp"
 #include "image/libvips.hpp"
+#include "image/memory.hpp"
+#include "image/raw.hpp"
 #include "util.hpp"
 
 #ifdef ENABLE_OPENCV
 #  include <opencv2/imgcodecs.hpp>
 #endif
+#include <cstring>
 #include <spdlog/spdlog.h>
 #include <vips/vips.h>
 
@@ -47,6 +53,35 @@ auto Image::load(const njson &command, const Terminal *terminal) -> std::unique_
         logger->error("Could not parse dimensions from command");
         return nullptr;
     }
+    const auto frame_cache = FrameCache::instance();
+    const auto frame_key = frame_cache->make_key(filename, *dimensions);
+    if (frame_key.has_value()) {
+        const auto frame = frame_cache->get(frame_key.value());
+        if (frame) {
+            auto image = std::make_unique<MemoryImage>(dimensions, frame);
+            image->source_path = filename;
+            return image;
+        }
+    }
+
+    // iterm2 sends the image file, pixels are useless to it
+    const bool use_raw_cache = !flags->no_cache && flags->cache_format == "raw" && flags->output != "iterm2";
+    if (use_raw_cache) {
+        const auto raw_path = DiskCache::instance()->find(filename, *dimensions, RawImage::format());
+        if (raw_path.has_value()) {
+            try {
+                auto image = std::make_unique<RawImage>(dimensions, raw_path.value());
+                image->source_path = filename;
+                if (frame_key.has_value()) {
+                    frame_cache->insert(frame_key.value(), *image);
+                }
+                return image;
+            } catch (const std::exception &) {
+                logger->debug("Could not load raw image {}", raw_path.value());
+            }
+        }
+    }
+
     std::string image_path = filename;
     bool in_cache = false;
     if (!flags->no_cache) {
@@ -54,8 +89,32 @@ auto Image::load(const njson &command, const Terminal *terminal) -> std::unique_
         in_cache = image_path != filename;
     }
 
+    auto image = create(dimensions, image_path, in_cache);
+    if (!image) {
+        return image;
+    }
+    image->source_path = filename;
+    if (image->is_animated()) {
+        return image;
+    }
+    if (frame_key.has_value()) {
+        frame_cache->insert(frame_key.value(), *image);
+    }
+    if (use_raw_cache) {
+        RawImage::save(filename, *image);
+    }
+    return image;
+}
+
+auto Image::create(const std::shared_ptr<Dimensions> &dimensions, const std::string &image_path, bool in_cache)
+    -> std::unique_ptr<Image>
+{
 #ifdef ENABLE_OPENCV
-    if (cv::haveImageReader(image_path) && !flags->no_opencv) {
+    const auto flags = Flags::instance();
+    // opencv only decodes jpeg at a reduced scale, webp and heif previews
+    // are shrunk on load by libvips instead
+    const bool prefer_vips = !in_cache && LibvipsImage::shrinks_on_load(image_path);
+    if (cv::haveImageReader(image_path) && !flags->no_opencv && !prefer_vips) {
         try {
             return std::make_unique<OpencvImage>(dimensions, image_path, in_cache);
         } catch (const std::runtime_error &) {
@@ -71,40 +130,75 @@ auto Image::load(const njson &command, const Terminal *terminal) -> std::unique_
             return nullptr;
         }
     }
+#ifdef ENABLE_OPENCV
+    // iterm2 sends the file itself, terminals can't play videos
+    if (flags->output != "iterm2" && VideoImage::is_video(image_path)) {
+        try {
+            return std::make_unique<VideoImage>(dimensions, image_path);
+        } catch (const std::runtime_error &) {
+            return nullptr;
+        }
+    }
+#endif
     return nullptr;
 }
 
-auto Image::check_cache(const Dimensions &dimensions, const fs::path &orig_path) -> std::string
+void Image::prefetch(const njson &command, const Terminal *terminal)
 {
-    const fs::path cache_path = util::get_cache_file_save_location(orig_path);
-    if (!fs::exists(cache_path)) {
-        return orig_path;
+    const auto flags = Flags::instance();
+    if (flags->no_cache) {
+        return;
     }
-
-    vips::VImage cache_img;
-    try {
-        cache_img = vips::VImage::new_from_file(cache_path.c_str());
-    } catch (const vips::VError &) {
-        return orig_path;
+    const fs::path &filename = command.at("path");
+    if (!fs::exists(filename)) {
+        return;
     }
-    const uint32_t img_width = cache_img.width();
-    const uint32_t img_height = cache_img.height();
-    const uint32_t dim_width = dimensions.max_wpixels();
-    const uint32_t dim_height = dimensions.max_hpixels();
-    const int delta = 10;
-
-    if ((dim_width >= img_width && dim_height >= img_height) &&
-        ((dim_width - img_width) <= delta || (dim_height - img_height) <= delta)) {
-        return cache_path;
+    const auto dimensions = get_dimensions(command, terminal);
+    if (check_cache(*dimensions, filename) != filename) {
+        return;
+    }
+    // only still images are resized ahead of time. Animations and videos
+    // would start decoder threads for files that might never be shown, and
+    // the frame and raw caches are left to images that are displayed
+    const auto logger = spdlog::get("main");
+#ifdef ENABLE_OPENCV
+    if (cv::haveImageReader(filename) && !flags->no_opencv && !LibvipsImage::shrinks_on_load(filename)) {
+        logger->debug("Prefetching file {}", filename.string());
+        std::ignore = OpencvImage(dimensions, filename, false);
+        return;
+    }
+#endif
+    if (vips_foreign_find_load(filename.c_str()) == nullptr || LibvipsImage::has_animation(filename)) {
+        return;
     }
-    return orig_path;
+    logger->debug("Prefetching file {}", filename.string());
+    std::ignore = LibvipsImage(dimensions, filename, false);
+}
+
+void Image::write_to(unsigned char *dst) const
+{
+    std::memcpy(dst, data(), size());
+}
+
+auto Image::damage() const -> std::vector<damage::Rect>
+{
+    return damage::full(width(), height());
+}
+
+auto Image::check_cache(const Dimensions &dimensions, const fs::path &orig_path) -> std::string
+{
+    return DiskCache::instance()->find(orig_path, dimensions).value_or(orig_path);
 }
 
 auto Image::get_new_sizes(double max_width, double max_height, std::string_view scaler, int scale_factor) const
     -> std::pair<int, int>
 {
-    int img_width = width();
-    int img_height = height();
+    return get_new_sizes(width(), height(), max_width, max_height, scaler, scale_factor);
+}
+
+auto Image::get_new_sizes(int img_width, int img_height, double max_width, double max_height,
+                          std::string_view scaler, int scale_factor) -> std::pair<int, int>
+{
     int new_width = img_width;
     int new_height = img_height;
     double new_scale = 0;
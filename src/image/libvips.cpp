@@ -15,13 +15,19 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "libvips.hpp"
+#include "../cache/disk.hpp"
+#include "stream.hpp"
 #include "dimensions.hpp"
 #include "flags.hpp"
 #include "terminal.hpp"
 #include "util.hpp"
+#include "util/pixels.hpp"
 
 #include <algorithm>
+#include <cstring>
+#include <string_view>
 #include <unordered_set>
+#include <utility>
 
 #ifdef ENABLE_OPENCV
 #  include <opencv2/videoio.hpp>
@@ -30,6 +36,10 @@
 using vips::VError;
 using vips::VImage;
 
+constexpr int exif_orientation_normal = 1;
+// orientations 5 to 8 swap width and height
+constexpr int exif_orientation_transposed = 5;
+
 LibvipsImage::LibvipsImage(std::shared_ptr<Dimensions> new_dims, const std::string &filename, bool in_cache)
     : path(filename),
       dims(std::move(new_dims)),
@@ -45,23 +55,134 @@ LibvipsImage::LibvipsImage(std::shared_ptr<Dimensions> new_dims, const std::stri
     try {
         // animated images should have both n-pages and delay
         npages = image.get_int("n-pages");
-        std::ignore = image.get_array_int("delay");
+        delays = image.get_array_int("delay");
         is_anim = true;
-        logger->info("file is an animated image");
-        auto *opts = VImage::option()->set("n", -1);
-        backup = VImage::new_from_file(filename.c_str(), opts).colourspace(VIPS_INTERPRETATION_sRGB);
-        orig_height = backup.height() / npages;
-        image = backup.crop(0, 0, backup.width(), orig_height);
     } catch (const VError &err) {
         logger->debug("Failed to process image animation");
     }
 
-    if (!is_anim) {
-        image = image.autorot();
+    if (is_anim) {
+        init_animation();
+        return;
     }
+    shrink_on_load();
     process_image();
 }
 
+LibvipsImage::~LibvipsImage() = default;
+
+// thumbnail makes these loaders decode at a reduced size, opencv can only
+// do that for jpeg
+auto LibvipsImage::shrinks_on_load(const std::string &filename) -> bool
+{
+    const auto *loader = vips_foreign_find_load(filename.c_str());
+    if (loader == nullptr) {
+        return false;
+    }
+    const std::string_view name = loader;
+    return name.find("Webp") != std::string_view::npos || name.find("Heif") != std::string_view::npos;
+}
+
+auto LibvipsImage::has_animation(const std::string &filename) -> bool
+{
+    const auto header = VImage::new_from_file(filename.c_str());
+    return header.get_typeof("n-pages") != 0 && header.get_typeof("delay") != 0;
+}
+
+// pages are decoded and converted a few frames ahead by a FrameStream
+// instead of loading every page into one tall image
+auto LibvipsImage::init_animation() -> void
+{
+    logger->info("file is an animated image");
+    auto [new_width, new_height] =
+        get_new_sizes(image.width(), image.height(), max_width, max_height, dims->scaler, flags->scale_factor);
+    if (new_width <= 0 && new_height <= 0 && flags->needs_scaling) {
+        // ensure width and height are pair
+        if ((image.width() % 2) != 0 || (image.height() % 2) != 0) {
+            new_width = util::round_up(image.width(), flags->scale_factor);
+            new_height = util::round_up(image.height(), flags->scale_factor);
+        }
+    }
+    anim_width = new_width;
+    anim_height = new_height;
+
+#ifdef ENABLE_OPENCV
+    // the fps is only a fallback, don't demux the file again when every page
+    // already has a delay
+    const bool has_delays = std::cmp_greater_equal(delays.size(), npages) &&
+                            std::ranges::all_of(delays, [](int delay) { return delay > 0; });
+    if (!has_delays) {
+        const cv::VideoCapture video(path);
+        if (video.isOpened()) {
+            const int ms_per_sec = 1000;
+            default_delay = static_cast<int>((1.0 / video.get(cv::CAP_PROP_FPS)) * ms_per_sec);
+        }
+    }
+#endif
+    if (default_delay <= 0) {
+        const int ms_per_sec = 1000;
+        default_delay = static_cast<int>((1.0 / npages) * ms_per_sec);
+    }
+
+    const size_t mib = 1024 * 1024;
+    const auto budget = static_cast<size_t>(std::max(flags->animation_cache_size, 0)) * mib;
+    const auto layout = output_layout(image.has_alpha() ? pixels::Layout::rgba : pixels::Layout::rgb);
+    stream = std::make_unique<FrameStream>(
+        path, npages, [this](const VImage &page) { return convert_page(page); }, layout, premultiply_output(),
+        budget);
+    frame_data = stream->next();
+    if (frame_data == nullptr) {
+        throw VError("could not decode animation");
+    }
+
+    if (flags->origin_center) {
+        const double img_width = static_cast<double>(width()) / dims->terminal->font_width;
+        const double img_height = static_cast<double>(height()) / dims->terminal->font_height;
+        dims->x -= std::floor(img_width / 2);
+        dims->y -= std::floor(img_height / 2);
+    }
+}
+
+// runs on the stream thread
+auto LibvipsImage::convert_page(const VImage &page) const -> VImage
+{
+    VImage img = page;
+    if (anim_width > 0 || anim_height > 0) {
+        auto *opts = VImage::option()->set("height", anim_height)->set("size", VIPS_SIZE_FORCE);
+        img = img.thumbnail_image(anim_width, opts);
+    }
+#ifdef ENABLE_OPENGL
+    if (flags->use_opengl) {
+        img = img.flipver();
+    }
+#endif
+    return img;
+}
+
+// decode straight to the target size, this lets the jpeg, webp and heif
+// loaders skip most of the source pixels. thumbnail also applies autorot
+auto LibvipsImage::shrink_on_load() -> void
+{
+    if (!in_cache) {
+        int img_width = image.width();
+        int img_height = image.height();
+        if (image.get_typeof(VIPS_META_ORIENTATION) != 0 && image.get_int(VIPS_META_ORIENTATION) >= exif_orientation_transposed) {
+            std::swap(img_width, img_height);
+        }
+        const auto [new_width, new_height] =
+            get_new_sizes(img_width, img_height, max_width, max_height, dims->scaler, flags->scale_factor);
+        if (new_width > 0 && new_height > 0) {
+            logger->debug("Shrinking image on load");
+            auto *opts = VImage::option()->set("height", new_height)->set("size", VIPS_SIZE_FORCE);
+            image = VImage::thumbnail(path.c_str(), new_width, opts).colourspace(VIPS_INTERPRETATION_sRGB);
+            shrunk_on_load = true;
+            return;
+        }
+    }
+    rotated = image.get_typeof(VIPS_META_ORIENTATION) != 0 && image.get_int(VIPS_META_ORIENTATION) > exif_orientation_normal;
+    image = image.autorot();
+}
+
 auto LibvipsImage::dimensions() const -> const Dimensions &
 {
     return *dims;
@@ -74,27 +195,49 @@ auto LibvipsImage::filename() const -> std::string
 
 auto LibvipsImage::width() const -> int
 {
+    if (stream) {
+        return stream->width();
+    }
     return image.width();
 }
 
 auto LibvipsImage::height() const -> int
 {
+    if (stream) {
+        return stream->height();
+    }
     return image.height();
 }
 
 auto LibvipsImage::size() const -> size_t
 {
+    if (stream) {
+        return stream->frame_size();
+    }
     return _size;
 }
 
 auto LibvipsImage::data() const -> const unsigned char *
 {
-    return _data.get();
+    if (stream) {
+        return frame_data;
+    }
+    if (!needs_conversion) {
+        return _data.get();
+    }
+    std::call_once(converted_flag, [this] {
+        converted.reset(static_cast<unsigned char *>(g_malloc(_size)));
+        write_to(converted.get());
+    });
+    return converted.get();
 }
 
 auto LibvipsImage::channels() const -> int
 {
-    return image.bands();
+    if (stream) {
+        return stream->channels();
+    }
+    return _channels;
 }
 
 auto LibvipsImage::is_animated() const -> bool
@@ -102,17 +245,37 @@ auto LibvipsImage::is_animated() const -> bool
     return is_anim;
 }
 
+auto LibvipsImage::frame_index() const -> int
+{
+    if (!is_anim) {
+        return 0;
+    }
+    return std::max(stream->page(), 0);
+}
+
 auto LibvipsImage::next_frame() -> void
 {
     if (!is_anim) {
         return;
     }
-    top += orig_height;
-    if (top == backup.height()) {
-        top = 0;
+    // keep showing the last frame if decoding failed or fell behind, the
+    // animation scheduler drives every animation from one thread
+    const auto *next = stream->next(false);
+    frame_changed = next != nullptr;
+    if (frame_changed) {
+        frame_data = next;
     }
-    image = backup.crop(0, top, backup.width(), orig_height);
-    process_image();
+}
+
+auto LibvipsImage::damage() const -> std::vector<damage::Rect>
+{
+    if (!stream) {
+        return Image::damage();
+    }
+    if (!frame_changed) {
+        return {};
+    }
+    return stream->damage();
 }
 
 auto LibvipsImage::frame_delay() const -> int
@@ -120,57 +283,62 @@ auto LibvipsImage::frame_delay() const -> int
     if (!is_anim) {
         return -1;
     }
-    try {
-        const auto delays = backup.get_array_int("delay");
-        const int ms_per_sec = 1000;
-        if (delays.at(0) == 0) {
-#ifdef ENABLE_OPENCV
-            const cv::VideoCapture video(path);
-            if (video.isOpened()) {
-                return static_cast<int>((1.0 / video.get(cv::CAP_PROP_FPS)) * ms_per_sec);
-            }
-#endif
-            return static_cast<int>((1.0 / npages) * ms_per_sec);
-        }
-        return delays.at(0);
-    } catch (const VError &err) {
-        return -1;
+    const auto page = static_cast<size_t>(std::max(stream->page(), 0));
+    if (page < delays.size() && delays.at(page) > 0) {
+        return delays.at(page);
     }
+    return default_delay;
 }
 
 auto LibvipsImage::resize_image() -> void
 {
     if (in_cache) {
+        if (!rotated) {
+            identical_path = path.string();
+        }
         return;
     }
-    const auto [new_width, new_height] = get_new_sizes(max_width, max_height, dims->scaler, flags->scale_factor);
-    if (new_width <= 0 && new_height <= 0) {
-        // ensure width and height are pair
-        if (flags->needs_scaling) {
-            const auto curw = width();
-            const auto curh = height();
-            if ((curw % 2) != 0 || (curh % 2) != 0) {
-                auto *opts = VImage::option()
-                                 ->set("height", util::round_up(curh, flags->scale_factor))
-                                 ->set("size", VIPS_SIZE_FORCE);
-                image = image.thumbnail_image(util::round_up(curw, flags->scale_factor), opts);
+    if (!shrunk_on_load) {
+        const auto [new_width, new_height] = get_new_sizes(max_width, max_height, dims->scaler, flags->scale_factor);
+        if (new_width <= 0 && new_height <= 0) {
+            // ensure width and height are pair
+            if (flags->needs_scaling) {
+                const auto curw = width();
+                const auto curh = height();
+                if ((curw % 2) != 0 || (curh % 2) != 0) {
+                    auto *opts = VImage::option()
+                                     ->set("height", util::round_up(curh, flags->scale_factor))
+                                     ->set("size", VIPS_SIZE_FORCE);
+                    image = image.thumbnail_image(util::round_up(curw, flags->scale_factor), opts);
+                    return;
+                }
             }
+            if (!rotated) {
+                identical_path = path.string();
+            }
+            return;
         }
-        return;
-    }
 
-    logger->debug("Resizing image");
+        logger->debug("Resizing image");
 
-    auto *opts = VImage::option()->set("height", new_height)->set("size", VIPS_SIZE_FORCE);
-    image = image.thumbnail_image(new_width, opts);
+        auto *opts = VImage::option()->set("height", new_height)->set("size", VIPS_SIZE_FORCE);
+        image = image.thumbnail_image(new_width, opts);
+    }
 
-    if (is_anim || flags->no_cache) {
+    if (flags->no_cache) {
         return;
     }
 
-    const auto save_location = util::get_cache_file_save_location(path);
+    const int new_width = width();
+    const int new_height = height();
+    const auto save_location = DiskCache::save_location(path, new_width, new_height);
+    if (!save_location.has_value()) {
+        return;
+    }
     try {
-        image.write_to_file(save_location.c_str());
+        image.write_to_file(save_location->c_str());
+        DiskCache::instance()->insert(save_location.value(), new_width, new_height);
+        identical_path = save_location.value();
         logger->debug("Saved resized image");
     } catch (const VError &err) {
         logger->debug("Could not save resized image");
@@ -187,30 +355,53 @@ auto LibvipsImage::process_image() -> void
         dims->y -= std::floor(img_height / 2);
     }
 
-    const std::unordered_set<std::string_view> bgra_trifecta = {"x11", "chafa", "wayland"};
-
 #ifdef ENABLE_OPENGL
     if (flags->use_opengl) {
         image = image.flipver();
+        identical_path.clear();
     }
 #endif
+    if (premultiply_output() || image.format() != VIPS_FORMAT_UCHAR) {
+        identical_path.clear();
+    }
+
+    // the conversion to the output format happens in write_to, straight into
+    // the buffer of whoever asks for the pixels
+    size_t size = 0;
+    _data.reset(static_cast<unsigned char *>(image.write_to_memory(&size)));
+    from = image.has_alpha() ? pixels::Layout::rgba : pixels::Layout::rgb;
+    to = output_layout(from);
+    _channels = pixels::channels(to);
+    _size = static_cast<size_t>(width()) * height() * _channels;
+    needs_conversion = from != to || premultiply_output();
+}
+
+void LibvipsImage::write_to(unsigned char *dst) const
+{
+    if (stream || !needs_conversion) {
+        std::memcpy(dst, data(), size());
+        return;
+    }
+    const auto count = static_cast<size_t>(width()) * height();
+    pixels::convert(_data.get(), from, dst, to, count, premultiply_output());
+}
 
+auto LibvipsImage::output_layout(pixels::Layout from) const -> pixels::Layout
+{
+    const std::unordered_set<std::string_view> bgra_trifecta = {"x11", "chafa", "wayland"};
     if (bgra_trifecta.contains(flags->output)) {
-        // alpha channel required
-        if (!image.has_alpha()) {
-            const int alpha_value = 255;
-            image = image.bandjoin(alpha_value);
-        }
-        // convert from RGB to BGR
-        auto bands = image.bandsplit();
-        std::swap(bands[0], bands[2]);
-        image = VImage::bandjoin(bands);
-    } else if (flags->output == "sixel") {
-        // sixel expects RGB888
-        if (image.has_alpha()) {
-            image = image.flatten();
-        }
+        return pixels::Layout::bgra;
+    }
+    // sixel expects RGB888
+    if (flags->output == "sixel") {
+        return pixels::Layout::rgb;
     }
-    _size = VIPS_IMAGE_SIZEOF_IMAGE(image.get_image());
-    _data.reset(static_cast<unsigned char *>(image.write_to_memory(&_size)));
+    return from;
+}
+
+// flattening on a black background, what sixel needs, is the same as
+// premultiplying and dropping the alpha channel
+auto LibvipsImage::premultiply_output() const -> bool
+{
+    return flags->output == "sixel";
 }
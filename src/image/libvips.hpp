@@ -18,17 +18,28 @@
 #define LIBVIPS_IMAGE_H
 
 #include "image.hpp"
+#include "util/pixels.hpp"
 #include "util/ptr.hpp"
 
 #include <filesystem>
+#include <memory>
+#include <mutex>
 #include <spdlog/spdlog.h>
 #include <string>
+#include <vector>
 #include <vips/vips8>
 
+class FrameStream;
+
 class LibvipsImage : public Image
 {
   public:
     LibvipsImage(std::shared_ptr<Dimensions> new_dims, const std::string &filename, bool in_cache);
+    ~LibvipsImage() override;
+
+    // reads only the header of the file
+    [[nodiscard]] static auto has_animation(const std::string &filename) -> bool;
+    [[nodiscard]] static auto shrinks_on_load(const std::string &filename) -> bool;
 
     [[nodiscard]] auto dimensions() const -> const Dimensions & override;
     [[nodiscard]] auto width() const -> int override;
@@ -36,17 +47,25 @@ class LibvipsImage : public Image
     [[nodiscard]] auto size() const -> size_t override;
     [[nodiscard]] auto data() const -> const unsigned char * override;
     [[nodiscard]] auto channels() const -> int override;
+    void write_to(unsigned char *dst) const override;
+    [[nodiscard]] auto damage() const -> std::vector<damage::Rect> override;
 
     void next_frame() override;
     [[nodiscard]] auto frame_delay() const -> int override;
     [[nodiscard]] auto is_animated() const -> bool override;
+    [[nodiscard]] auto frame_index() const -> int override;
     [[nodiscard]] auto filename() const -> std::string override;
 
   private:
     vips::VImage image;
-    vips::VImage backup;
 
     c_unique_ptr<unsigned char, g_free> _data;
+    // pixels in the output format, only filled if someone asks for data()
+    mutable c_unique_ptr<unsigned char, g_free> converted;
+    mutable std::once_flag converted_flag;
+    pixels::Layout from = pixels::Layout::rgb;
+    pixels::Layout to = pixels::Layout::rgb;
+    bool needs_conversion = false;
     std::filesystem::path path;
     std::shared_ptr<Dimensions> dims;
 
@@ -56,16 +75,30 @@ class LibvipsImage : public Image
     uint32_t max_width;
     uint32_t max_height;
     size_t _size = 0;
+    int _channels = 0;
+
+    bool in_cache;
+    bool shrunk_on_load = false;
+    bool rotated = false;
 
     // for animated pictures
-    int top = 0;
-    int orig_height;
     int npages = 0;
+    int anim_width = 0;
+    int anim_height = 0;
+    int default_delay = -1;
     bool is_anim = false;
-    bool in_cache;
+    std::vector<int> delays;
+    const unsigned char *frame_data = nullptr;
+    bool frame_changed = true;
+    std::unique_ptr<FrameStream> stream;
 
     void process_image();
     void resize_image();
+    void shrink_on_load();
+    void init_animation();
+    [[nodiscard]] auto convert_page(const vips::VImage &page) const -> vips::VImage;
+    [[nodiscard]] auto output_layout(pixels::Layout from) const -> pixels::Layout;
+    [[nodiscard]] auto premultiply_output() const -> bool;
 };
 
 #endif
@@ -0,0 +1,70 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "memory.hpp"
+#include "dimensions.hpp"
+#include "flags.hpp"
+#include "terminal.hpp"
+
+#include <cmath>
+
+MemoryImage::MemoryImage(std::shared_ptr<Dimensions> new_dims, std::shared_ptr<const Frame> frame)
+    : dims(std::move(new_dims)),
+      frame(std::move(frame))
+{
+    const auto flags = Flags::instance();
+    if (flags->origin_center) {
+        const double img_width = static_cast<double>(width()) / dims->terminal->font_width;
+        const double img_height = static_cast<double>(height()) / dims->terminal->font_height;
+        dims->x -= std::floor(img_width / 2);
+        dims->y -= std::floor(img_height / 2);
+    }
+}
+
+auto MemoryImage::dimensions() const -> const Dimensions &
+{
+    return *dims;
+}
+
+auto MemoryImage::filename() const -> std::string
+{
+    return frame->filename;
+}
+
+auto MemoryImage::width() const -> int
+{
+    return frame->width;
+}
+
+auto MemoryImage::height() const -> int
+{
+    return frame->height;
+}
+
+auto MemoryImage::size() const -> size_t
+{
+    return frame->pixels.size();
+}
+
+auto MemoryImage::data() const -> const unsigned char *
+{
+    return frame->pixels.data();
+}
+
+auto MemoryImage::channels() const -> int
+{
+    return frame->channels;
+}
@@ -0,0 +1,47 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef MEMORY_IMAGE_H
+#define MEMORY_IMAGE_H
+
+#include "../cache/frame.hpp"
+#include "image.hpp"
+
+#include <memory>
+#include <string>
+
+// image restored from the frame cache, already resized and converted. the
+// pixels are shared with the cache
+class MemoryImage : public Image
+{
+  public:
+    MemoryImage(std::shared_ptr<Dimensions> new_dims, std::shared_ptr<const Frame> frame);
+
+    [[nodiscard]] auto dimensions() const -> const Dimensions & override;
+    [[nodiscard]] auto width() const -> int override;
+    [[nodiscard]] auto height() const -> int override;
+    [[nodiscard]] auto size() const -> size_t override;
+    [[nodiscard]] auto data() const -> const unsigned char * override;
+    [[nodiscard]] auto channels() const -> int override;
+
+    [[nodiscard]] auto filename() const -> std::string override;
+
+  private:
+    std::shared_ptr<Dimensions> dims;
+    std::shared_ptr<const Frame> frame;
+};
+
+#endif
@@ -15,17 +15,21 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "opencv.hpp"
+#include "../cache/disk.hpp"
 #include "dimensions.hpp"
 #include "flags.hpp"
 #include "terminal.hpp"
 #include "util.hpp"
+#include "util/pixels.hpp"
 
+#include <cstring>
 #include <string_view>
 #include <unordered_set>
 
 #include <opencv2/core/ocl.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
+#include <vips/vips8>
 
 enum {
     EXIF_ORIENTATION_2 = 2,
@@ -45,14 +49,14 @@ OpencvImage::OpencvImage(std::shared_ptr<Dimensions> new_dims, const std::string
       in_cache(in_cache)
 {
     logger = spdlog::get("opencv");
-    image = cv::imread(filename, cv::IMREAD_UNCHANGED);
+    flags = Flags::instance();
+    image = cv::imread(filename, read_mode());
 
     if (image.empty()) {
         logger->warn("unable to read image");
         throw std::runtime_error("");
     }
     logger->info("loading file {}", filename);
-    flags = Flags::instance();
 
     rotate_image();
     process_image();
@@ -85,12 +89,19 @@ auto OpencvImage::size() const -> size_t
 
 auto OpencvImage::data() const -> const unsigned char *
 {
-    return image.data;
+    if (!needs_conversion && image.isContinuous()) {
+        return image.data;
+    }
+    std::call_once(converted_flag, [this] {
+        converted.create(image.rows, image.cols, CV_8UC(out_channels));
+        write_to(converted.data);
+    });
+    return converted.data;
 }
 
 auto OpencvImage::channels() const -> int
 {
-    return image.channels();
+    return out_channels;
 }
 
 void OpencvImage::wayland_processing()
@@ -100,6 +111,53 @@ void OpencvImage::wayland_processing()
     }
 }
 
+// let libjpeg decode at 1/2, 1/4 or 1/8 scale when the preview is much
+// smaller than the source, the final resize still happens in resize_image.
+// opencv decodes every other format whole with the reduced modes and drops
+// its alpha, webp and heif are shrunk on load by libvips instead
+auto OpencvImage::read_mode() const -> int
+{
+    if (in_cache) {
+        return cv::IMREAD_UNCHANGED;
+    }
+    try {
+        const auto *loader = vips_foreign_find_load(path.c_str());
+        if (loader == nullptr || std::string_view{loader}.find("Jpeg") == std::string_view::npos) {
+            return cv::IMREAD_UNCHANGED;
+        }
+        const auto header = vips::VImage::new_from_file(path.c_str());
+        int img_width = header.width();
+        int img_height = header.height();
+        if (header.get_typeof(VIPS_META_ORIENTATION) != 0 &&
+            header.get_int(VIPS_META_ORIENTATION) >= EXIF_ORIENTATION_5) {
+            std::swap(img_width, img_height);
+        }
+        const auto [new_width, new_height] =
+            get_new_sizes(img_width, img_height, max_width, max_height, dims->scaler, flags->scale_factor);
+        if (new_width <= 0 || new_height <= 0) {
+            return cv::IMREAD_UNCHANGED;
+        }
+        const int factor = std::min(img_width / new_width, img_height / new_height);
+        // EXIF orientation is applied by rotate_image, same as with IMREAD_UNCHANGED
+        const int ignore = cv::IMREAD_IGNORE_ORIENTATION;
+        if (factor >= 8) {
+            logger->debug("Decoding at 1/8 scale");
+            return cv::IMREAD_REDUCED_COLOR_8 | ignore;
+        }
+        if (factor >= 4) {
+            logger->debug("Decoding at 1/4 scale");
+            return cv::IMREAD_REDUCED_COLOR_4 | ignore;
+        }
+        if (factor >= 2) {
+            logger->debug("Decoding at 1/2 scale");
+            return cv::IMREAD_REDUCED_COLOR_2 | ignore;
+        }
+    } catch (const vips::VError &) {
+        // let opencv report the error
+    }
+    return cv::IMREAD_UNCHANGED;
+}
+
 void OpencvImage::rotate_image()
 {
     const auto rotation = util::read_exif_rotation(path);
@@ -107,6 +165,7 @@ void OpencvImage::rotate_image()
         return;
     }
     const auto value = rotation.value();
+    rotated = value >= EXIF_ORIENTATION_2 && value <= EXIF_ORIENTATION_8;
 
     // kudos https://jdhao.github.io/2019/07/31/image_rotation_exif_info/
     switch (value) {
@@ -142,6 +201,9 @@ void OpencvImage::rotate_image()
 auto OpencvImage::resize_image() -> void
 {
     if (in_cache) {
+        if (!rotated) {
+            identical_path = path.string();
+        }
         return;
     }
     const auto [new_width, new_height] = get_new_sizes(max_width, max_height, dims->scaler, flags->scale_factor);
@@ -153,8 +215,12 @@ auto OpencvImage::resize_image() -> void
             if ((curw % 2) != 0 || (curh % 2) != 0) {
                 resize_image_helper(image, util::round_up(curw, flags->scale_factor),
                                     util::round_up(curh, flags->scale_factor));
+                return;
             }
         }
+        if (!rotated) {
+            identical_path = path.string();
+        }
         return;
     }
 
@@ -181,10 +247,16 @@ void OpencvImage::resize_image_helper(cv::InputOutputArray &mat, int new_width,
         return;
     }
 
-    const auto save_location = util::get_cache_file_save_location(path);
+    const auto save_location = DiskCache::save_location(path, new_width, new_height);
+    if (!save_location.has_value()) {
+        return;
+    }
     try {
-        cv::imwrite(save_location, mat);
-        logger->debug("Saved resized image");
+        if (cv::imwrite(save_location.value(), mat)) {
+            DiskCache::instance()->insert(save_location.value(), new_width, new_height);
+            identical_path = save_location.value();
+            logger->debug("Saved resized image");
+        }
     } catch (const cv::Exception &ex) {
         logger->error("Could not save image");
     }
@@ -200,50 +272,68 @@ void OpencvImage::process_image()
         dims->y -= std::floor(img_height / 2);
     }
 
-    const std::unordered_set<std::string_view> bgra_trifecta = {"x11", "chafa", "wayland"};
-
-    if (image.depth() == CV_16U) {
-        const float alpha = 0.00390625; // 1 / 256
-        image.convertTo(image, CV_8U, alpha);
-    }
-
-    if (image.channels() == 4) {
-        // premultiply alpha
-        image.forEach<cv::Vec4b>([](cv::Vec4b &pix, const int *) {
-            const uint8_t alpha = pix[3];
-            const uint8_t div = 255;
-            pix[0] = (pix[0] * alpha) / div;
-            pix[1] = (pix[1] * alpha) / div;
-            pix[2] = (pix[2] * alpha) / div;
-        });
-    }
-
 #ifdef ENABLE_OPENGL
     if (flags->use_opengl) {
         cv::flip(image, image, 0);
+        identical_path.clear();
     }
 #endif
 
+    prepare_conversion();
+    // swizzles keep the pixel values, anything else changes them
+    if (premultiply || image.depth() != CV_8U) {
+        identical_path.clear();
+    }
+}
+
+// picks the depth reduction, alpha premultiplication and swizzle needed by
+// the current output. the conversion itself happens in write_to, straight
+// into the buffer of whoever asks for the pixels
+void OpencvImage::prepare_conversion()
+{
+    using pixels::Layout;
+    out_channels = image.channels();
+    _size = image.total() * image.elemSize();
+    const bool is_16bit = image.depth() == CV_16U;
+    if ((image.depth() != CV_8U && !is_16bit) || image.channels() == 2) {
+        return;
+    }
+    from = Layout::bgr;
     if (image.channels() == 1) {
-        cv::cvtColor(image, image, cv::COLOR_GRAY2BGRA);
+        from = Layout::gray;
+    } else if (image.channels() == 4) {
+        from = Layout::bgra;
     }
 
+    const std::unordered_set<std::string_view> bgra_trifecta = {"x11", "chafa", "wayland"};
+    to = Layout::bgra;
     if (bgra_trifecta.contains(flags->output)) {
-        if (image.channels() == 3) {
-            cv::cvtColor(image, image, cv::COLOR_BGR2BGRA);
-        }
+        to = Layout::bgra;
     } else if (flags->output == "kitty") {
-        if (image.channels() == 4) {
-            cv::cvtColor(image, image, cv::COLOR_BGRA2RGBA);
-        } else {
-            cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
-        }
+        to = from == Layout::bgr ? Layout::rgb : Layout::rgba;
     } else if (flags->output == "sixel") {
-        if (image.channels() == 4) {
-            cv::cvtColor(image, image, cv::COLOR_BGRA2RGB);
+        to = Layout::rgb;
+    } else if (from == Layout::bgr) {
+        to = Layout::bgr;
+    }
+
+    premultiply = from == Layout::bgra;
+    needs_conversion = from != to || is_16bit || premultiply;
+    out_channels = pixels::channels(to);
+    _size = image.total() * out_channels;
+}
+
+void OpencvImage::write_to(unsigned char *dst) const
+{
+    const size_t row_size = static_cast<size_t>(image.cols) * out_channels;
+    for (int row = 0; row < image.rows; ++row) {
+        unsigned char *out = dst + (row * row_size);
+        if (!needs_conversion) {
+            std::memcpy(out, image.ptr(row), row_size);
+        } else if (image.depth() == CV_16U) {
+            pixels::convert(image.ptr<uint16_t>(row), from, out, to, image.cols, premultiply);
         } else {
-            cv::cvtColor(image, image, cv::COLOR_BGR2RGB);
+            pixels::convert(image.ptr(row), from, out, to, image.cols, premultiply);
         }
     }
-    _size = image.total() * image.elemSize();
 }
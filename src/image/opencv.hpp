@@ -18,8 +18,10 @@
 #define OPENCV_IMAGE_H
 
 #include "image.hpp"
+#include "util/pixels.hpp"
 
 #include <filesystem>
+#include <mutex>
 #include <opencv2/core.hpp>
 #include <spdlog/spdlog.h>
 #include <string>
@@ -38,6 +40,7 @@ class OpencvImage : public Image
     [[nodiscard]] auto size() const -> size_t override;
     [[nodiscard]] auto data() const -> const unsigned char * override;
     [[nodiscard]] auto channels() const -> int override;
+    void write_to(unsigned char *dst) const override;
 
     [[nodiscard]] auto filename() const -> std::string override;
 
@@ -45,6 +48,15 @@ class OpencvImage : public Image
     cv::Mat image;
     cv::UMat uimage;
 
+    // pixels in the output format, only filled if someone asks for data()
+    mutable cv::Mat converted;
+    mutable std::once_flag converted_flag;
+    pixels::Layout from = pixels::Layout::bgr;
+    pixels::Layout to = pixels::Layout::bgr;
+    int out_channels = 0;
+    bool premultiply = false;
+    bool needs_conversion = false;
+
     fs::path path;
     std::shared_ptr<Dimensions> dims;
 
@@ -53,6 +65,7 @@ class OpencvImage : public Image
     uint32_t max_height;
     bool in_cache;
     bool opencl_available = false;
+    bool rotated = false;
 
     std::shared_ptr<spdlog::logger> logger;
     std::shared_ptr<Flags> flags;
@@ -61,6 +74,8 @@ class OpencvImage : public Image
     void resize_image();
     void resize_image_helper(cv::InputOutputArray &mat, int new_width, int new_height);
 
+    [[nodiscard]] auto read_mode() const -> int;
+    void prepare_conversion();
     void rotate_image();
     void wayland_processing();
 };
@@ -0,0 +1,178 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "raw.hpp"
+#include "../cache/disk.hpp"
+#include "dimensions.hpp"
+#include "flags.hpp"
+#include "terminal.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+
+constexpr std::array<char, 4> raw_magic = {'U', 'B', 'Z', 'R'};
+constexpr uint32_t raw_version = 1;
+
+RawImage::RawImage(std::shared_ptr<Dimensions> new_dims, const std::string &filename)
+    : dims(std::move(new_dims)),
+      path(filename)
+{
+    const int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw std::system_error(errno, std::system_category());
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1 || static_cast<size_t>(file_stat.st_size) < sizeof(Header)) {
+        close(fd);
+        throw std::runtime_error("invalid raw image");
+    }
+    mapping_size = file_stat.st_size;
+    mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        throw std::system_error(errno, std::system_category());
+    }
+
+    std::memcpy(&header, mapping, sizeof(Header));
+    const auto expected_size =
+        sizeof(Header) + static_cast<size_t>(header.width) * header.height * header.channels;
+    const auto expected_format = make_header().format;
+    if (header.magic != raw_magic || header.version != raw_version || mapping_size != expected_size ||
+        header.format != expected_format) {
+        munmap(mapping, mapping_size);
+        throw std::runtime_error("invalid raw image");
+    }
+
+    const auto flags = Flags::instance();
+    if (flags->origin_center) {
+        const double img_width = static_cast<double>(width()) / dims->terminal->font_width;
+        const double img_height = static_cast<double>(height()) / dims->terminal->font_height;
+        dims->x -= std::floor(img_width / 2);
+        dims->y -= std::floor(img_height / 2);
+    }
+}
+
+RawImage::~RawImage()
+{
+    if (mapping != nullptr) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+auto RawImage::format() -> std::string
+{
+    const auto flags = Flags::instance();
+    if (flags->use_opengl) {
+        return fmt::format("raw-{}-flipped", flags->output);
+    }
+    return fmt::format("raw-{}", flags->output);
+}
+
+auto RawImage::make_header() -> Header
+{
+    Header result{};
+    result.magic = raw_magic;
+    result.version = raw_version;
+    const auto name = format();
+    std::memcpy(result.format.data(), name.data(), std::min(name.size(), result.format.size() - 1));
+    return result;
+}
+
+void RawImage::save(const fs::path &source, const Image &image)
+{
+    if (!DiskCache::fits(image.width(), image.height(), image.dimensions())) {
+        // would never be found by a lookup
+        return;
+    }
+    const auto save_location =
+        DiskCache::save_location(source, image.width(), image.height(), fmt::format(".{}", format()));
+    if (!save_location.has_value()) {
+        return;
+    }
+
+    auto raw_header = make_header();
+    raw_header.width = image.width();
+    raw_header.height = image.height();
+    raw_header.channels = image.channels();
+
+    const auto tmp_location = fmt::format("{}.tmp", save_location.value());
+    {
+        std::ofstream ofs(tmp_location, std::ios::out | std::ios::binary | std::ios::trunc);
+        ofs.write(reinterpret_cast<const char *>(&raw_header), sizeof(Header));
+        ofs.write(reinterpret_cast<const char *>(image.data()), static_cast<std::streamsize>(image.size()));
+        if (!ofs.flush()) {
+            std::error_code err;
+            fs::remove(tmp_location, err);
+            return;
+        }
+    }
+    std::error_code err;
+    fs::rename(tmp_location, save_location.value(), err);
+    if (err) {
+        return;
+    }
+    DiskCache::instance()->insert(save_location.value(), image.width(), image.height(), format());
+    spdlog::get("main")->debug("Saved raw image {}", save_location.value());
+}
+
+auto RawImage::dimensions() const -> const Dimensions &
+{
+    return *dims;
+}
+
+auto RawImage::filename() const -> std::string
+{
+    return path;
+}
+
+auto RawImage::width() const -> int
+{
+    return static_cast<int>(header.width);
+}
+
+auto RawImage::height() const -> int
+{
+    return static_cast<int>(header.height);
+}
+
+auto RawImage::size() const -> size_t
+{
+    return mapping_size - sizeof(Header);
+}
+
+auto RawImage::data() const -> const unsigned char *
+{
+    return static_cast<const unsigned char *>(mapping) + sizeof(Header);
+}
+
+auto RawImage::channels() const -> int
+{
+    return static_cast<int>(header.channels);
+}
@@ -0,0 +1,71 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RAW_IMAGE_H
+#define RAW_IMAGE_H
+
+#include "image.hpp"
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+// Cached image stored with the pixels already converted for the current
+// output, loading one is a mmap of the file.
+class RawImage : public Image
+{
+  public:
+    RawImage(std::shared_ptr<Dimensions> new_dims, const std::string &filename);
+    ~RawImage() override;
+
+    RawImage(const RawImage &) = delete;
+    auto operator=(const RawImage &) -> RawImage & = delete;
+
+    static void save(const std::filesystem::path &source, const Image &image);
+    [[nodiscard]] static auto format() -> std::string;
+
+    [[nodiscard]] auto dimensions() const -> const Dimensions & override;
+    [[nodiscard]] auto width() const -> int override;
+    [[nodiscard]] auto height() const -> int override;
+    [[nodiscard]] auto size() const -> size_t override;
+    [[nodiscard]] auto data() const -> const unsigned char * override;
+    [[nodiscard]] auto channels() const -> int override;
+
+    [[nodiscard]] auto filename() const -> std::string override;
+
+  private:
+    struct Header {
+        std::array<char, 4> magic;
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        std::array<char, 44> format;
+    };
+
+    std::shared_ptr<Dimensions> dims;
+    std::string path;
+
+    void *mapping = nullptr;
+    size_t mapping_size = 0;
+    Header header;
+
+    static auto make_header() -> Header;
+};
+
+#endif
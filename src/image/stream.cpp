@@ -0,0 +1,220 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "stream.hpp"
+
+#include <cstdlib>
+
+FrameStream::FrameStream(std::filesystem::path path, int npages, convert_t convert, pixels::Layout layout,
+                         bool premultiply, size_t budget)
+    : path(std::move(path)),
+      npages(npages),
+      convert(std::move(convert)),
+      layout(layout),
+      premultiply(premultiply),
+      budget(budget)
+{
+    logger = spdlog::get("vips");
+    decoder = std::thread([this] { decode_loop(); });
+}
+
+FrameStream::~FrameStream()
+{
+    {
+        const std::scoped_lock lock{stream_mutex};
+        stop = true;
+    }
+    stream_cv.notify_all();
+    if (decoder.joinable()) {
+        decoder.join();
+    }
+}
+
+auto FrameStream::next(bool wait) -> const unsigned char *
+{
+    if (!complete.load(std::memory_order_acquire)) {
+        std::unique_lock lock{stream_mutex};
+        const auto ready = [this] { return decoded > shown || failed || complete.load(); };
+        if (!wait && !ready()) {
+            return nullptr;
+        }
+        stream_cv.wait(lock, ready);
+        if (decoded > shown) {
+            const auto seq = shown;
+            shown += 1;
+            cursor = static_cast<int>(seq % npages);
+            current_slot = seq % slots;
+            lock.unlock();
+            stream_cv.notify_all();
+            return slot(seq);
+        }
+        if (failed) {
+            return nullptr;
+        }
+    }
+
+    // the whole loop is in memory and won't change anymore
+    cursor = (cursor + 1) % npages;
+    current_slot = cursor;
+    return slot(cursor);
+}
+
+auto FrameStream::damage() const -> const std::vector<damage::Rect> &
+{
+    if (cursor == 0 && complete.load(std::memory_order_acquire) && shown > 1) {
+        return loop_damage;
+    }
+    return damages.at(current_slot);
+}
+
+auto FrameStream::page() const -> int
+{
+    return cursor;
+}
+
+auto FrameStream::width() const -> int
+{
+    return _width;
+}
+
+auto FrameStream::height() const -> int
+{
+    return _height;
+}
+
+auto FrameStream::channels() const -> int
+{
+    return _channels;
+}
+
+auto FrameStream::frame_size() const -> size_t
+{
+    return _size;
+}
+
+auto FrameStream::slot(uint64_t seq) const -> unsigned char *
+{
+    return buffer.get() + ((seq % slots) * stride);
+}
+
+void FrameStream::decode_loop()
+{
+    while (true) {
+        uint64_t seq = 0;
+        {
+            std::unique_lock lock{stream_mutex};
+            // when streaming, never overwrite the slot being displayed
+            stream_cv.wait(lock, [this] { return stop || keep_all || decoded < shown + frames_ahead; });
+            if (stop) {
+                return;
+            }
+            seq = decoded;
+        }
+
+        bool success = false;
+        try {
+            success = decode(seq);
+        } catch (const vips::VError &err) {
+            logger->warn("Failed to decode page {}: {}", seq % npages, err.what());
+        }
+        {
+            const std::scoped_lock lock{stream_mutex};
+            if (success) {
+                decoded += 1;
+            } else {
+                failed = true;
+            }
+        }
+        stream_cv.notify_all();
+        if (!success) {
+            return;
+        }
+
+        if (keep_all && seq + 1 == static_cast<uint64_t>(npages)) {
+            logger->debug("Animation converted, closing source");
+            source = vips::VImage();
+            loop_damage = npages > 1 ? damage::diff(slot(seq), slot(0), _width, _height, _channels)
+                                     : damage::full(_width, _height);
+            {
+                const std::scoped_lock lock{stream_mutex};
+                complete.store(true, std::memory_order_release);
+            }
+            stream_cv.notify_all();
+            return;
+        }
+    }
+}
+
+auto FrameStream::decode(uint64_t seq) -> bool
+{
+    const auto page = static_cast<int>(seq % npages);
+    // sequential access only reads forward, start over on every loop
+    if (page == 0) {
+        auto *opts = vips::VImage::option()->set("n", -1)->set("access", VIPS_ACCESS_SEQUENTIAL);
+        source = vips::VImage::new_from_file(path.c_str(), opts).colourspace(VIPS_INTERPRETATION_sRGB);
+        page_height = source.height() / npages;
+    }
+    const auto image = convert(source.crop(0, page * page_height, source.width(), page_height));
+    if (!buffer && !allocate(image)) {
+        return false;
+    }
+    if (image.width() != _width || image.height() != _height) {
+        logger->warn("Page {} does not match the size of the first page", page);
+        return false;
+    }
+
+    // the output conversion doubles as the copy into the slot
+    const auto from = image.has_alpha() ? pixels::Layout::rgba : pixels::Layout::rgb;
+    size_t size = 0;
+    const c_unique_ptr<unsigned char, g_free> data{static_cast<unsigned char *>(image.write_to_memory(&size))};
+    const auto count = static_cast<size_t>(_width) * _height;
+    if (size != count * pixels::channels(from)) {
+        return false;
+    }
+    pixels::convert(data.get(), from, slot(seq), layout, count, premultiply);
+
+    // the previous slot is never reused before this one is published
+    auto &rects = damages.at(seq % slots);
+    if (seq == 0) {
+        rects = damage::full(_width, _height);
+    } else {
+        rects = damage::diff(slot(seq - 1), slot(seq), _width, _height, _channels);
+    }
+    return true;
+}
+
+// all pages share the size of the first one, so the ring is sized from it
+auto FrameStream::allocate(const vips::VImage &image) -> bool
+{
+    _width = image.width();
+    _height = image.height();
+    _channels = pixels::channels(layout);
+    _size = static_cast<size_t>(_width) * _height * _channels;
+    stride = (_size + alignment - 1) / alignment * alignment;
+
+    {
+        const std::scoped_lock lock{stream_mutex};
+        keep_all = stride * npages <= budget;
+    }
+    // the previous frame may still be read by a late expose, keep it intact too
+    slots = keep_all ? npages : frames_ahead + 2;
+    if (!keep_all) {
+        logger->debug("Animation is larger than {} bytes, streaming it", budget);
+    }
+    damages.resize(slots);
+    buffer.reset(static_cast<unsigned char *>(std::aligned_alloc(alignment, stride * slots)));
+    return buffer != nullptr;
+}
@@ -0,0 +1,114 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+
+#include "util/damage.hpp"
+#include "util/pixels.hpp"
+#include "util/ptr.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+#include <vips/vips8>
+
+// Decodes the pages of an animated image in order, a few frames ahead of the
+// one being displayed. Converted frames live in one aligned buffer. If a whole
+// loop fits in the budget every page gets its own slot, the source is closed
+// after the first loop and next() becomes a pointer increment.
+class FrameStream
+{
+  public:
+    using convert_t = std::function<vips::VImage(const vips::VImage &)>;
+
+    // convert resizes a page, its pixels are then turned into layout
+    FrameStream(std::filesystem::path path, int npages, convert_t convert, pixels::Layout layout, bool premultiply,
+                size_t budget);
+    ~FrameStream();
+
+    FrameStream(const FrameStream &) = delete;
+    auto operator=(const FrameStream &) -> FrameStream & = delete;
+
+    // returns nullptr if decoding failed, or without wait if the next page
+    // isn't ready yet. the last page returned stays valid in both cases
+    auto next(bool wait = true) -> const unsigned char *;
+
+    // only valid once next() returned a frame
+    [[nodiscard]] auto page() const -> int;
+    [[nodiscard]] auto width() const -> int;
+    [[nodiscard]] auto height() const -> int;
+    [[nodiscard]] auto channels() const -> int;
+    [[nodiscard]] auto frame_size() const -> size_t;
+    // areas that changed from the previous page
+    [[nodiscard]] auto damage() const -> const std::vector<damage::Rect> &;
+
+  private:
+    static constexpr uint64_t frames_ahead = 3;
+    static constexpr size_t alignment = 64;
+
+    std::filesystem::path path;
+    int npages;
+    convert_t convert;
+    pixels::Layout layout;
+    bool premultiply;
+    size_t budget;
+
+    vips::VImage source;
+    int page_height = 0;
+
+    int _width = 0;
+    int _height = 0;
+    int _channels = 0;
+    size_t _size = 0;
+    size_t stride = 0;
+    uint64_t slots = 0;
+    bool keep_all = false;
+    unique_C_ptr<unsigned char> buffer;
+    // computed along with each slot, the first page of a kept loop compares
+    // against the last one once the loop is complete
+    std::vector<std::vector<damage::Rect>> damages;
+    std::vector<damage::Rect> loop_damage;
+    uint64_t current_slot = 0;
+
+    std::mutex stream_mutex;
+    std::condition_variable stream_cv;
+    uint64_t decoded = 0;
+    uint64_t shown = 0;
+    int cursor = -1;
+    bool failed = false;
+    bool stop = false;
+    std::atomic<bool> complete = false;
+
+    std::thread decoder;
+    std::shared_ptr<spdlog::logger> logger;
+
+    void decode_loop();
+    auto decode(uint64_t seq) -> bool;
+    auto allocate(const vips::VImage &image) -> bool;
+    [[nodiscard]] auto slot(uint64_t seq) const -> unsigned char *;
+};
+
+#endif
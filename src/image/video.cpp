@@ -0,0 +1,333 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "video.hpp"
+#include "dimensions.hpp"
+#include "flags.hpp"
+#include "terminal.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+
+#include <opencv2/imgproc.hpp>
+
+auto VideoImage::is_video(const std::string &filename) -> bool
+{
+    const std::unordered_set<std::string_view> extensions = {
+        ".mp4", ".m4v", ".mkv", ".webm", ".mov", ".avi", ".mpg", ".mpeg", ".ogv", ".flv", ".wmv", ".ts", ".3gp"};
+    auto extension = std::filesystem::path(filename).extension().string();
+    std::ranges::transform(extension, extension.begin(), [](unsigned char chr) { return std::tolower(chr); });
+    if (extensions.contains(extension)) {
+        return true;
+    }
+
+    const size_t header_size = 12;
+    std::array<unsigned char, header_size> header{};
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs.read(reinterpret_cast<char *>(header.data()), header.size())) {
+        return false;
+    }
+    const auto starts_with = [&header](size_t offset, std::string_view magic) {
+        return std::equal(magic.begin(), magic.end(), header.begin() + offset,
+                          [](char lhs, unsigned char rhs) { return static_cast<unsigned char>(lhs) == rhs; });
+    };
+    // iso media (mp4, mov, 3gp), matroska/webm, avi, mpeg program stream, ogg, flv
+    return starts_with(4, "ftyp") || starts_with(0, "\x1A\x45\xDF\xA3") ||
+           (starts_with(0, "RIFF") && starts_with(8, "AVI ")) || starts_with(0, std::string_view{"\0\0\1\xBA", 4}) ||
+           starts_with(0, "OggS") || starts_with(0, "FLV");
+}
+
+VideoImage::VideoImage(std::shared_ptr<Dimensions> new_dims, const std::string &filename)
+    : video(filename),
+      path(filename),
+      dims(std::move(new_dims))
+{
+    logger = spdlog::get("opencv");
+    if (!video.isOpened()) {
+        throw std::runtime_error("");
+    }
+    logger->info("loading video {}", filename);
+    flags = Flags::instance();
+
+    double fps = video.get(cv::CAP_PROP_FPS);
+    if (fps <= 0) {
+        const double default_fps = 25;
+        fps = default_fps;
+    }
+    frame_duration = 1.0 / fps;
+
+    const auto video_width = static_cast<int>(video.get(cv::CAP_PROP_FRAME_WIDTH));
+    const auto video_height = static_cast<int>(video.get(cv::CAP_PROP_FRAME_HEIGHT));
+    std::tie(target_width, target_height) = get_new_sizes(video_width, video_height, dims->max_wpixels(),
+                                                          dims->max_hpixels(), dims->scaler, flags->scale_factor);
+    if (target_width <= 0 || target_height <= 0) {
+        target_width = video_width;
+        target_height = video_height;
+        // ensure width and height are pair
+        if (flags->needs_scaling) {
+            target_width = util::round_up(video_width, flags->scale_factor);
+            target_height = util::round_up(video_height, flags->scale_factor);
+        }
+    }
+
+    decoder = std::thread([this] { decode_loop(); });
+    next_frame();
+    if (current.empty()) {
+        stop_decoder();
+        throw std::runtime_error("");
+    }
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    start_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+
+    if (flags->origin_center) {
+        const double img_width = static_cast<double>(width()) / dims->terminal->font_width;
+        const double img_height = static_cast<double>(height()) / dims->terminal->font_height;
+        dims->x -= std::floor(img_width / 2);
+        dims->y -= std::floor(img_height / 2);
+    }
+}
+
+VideoImage::~VideoImage()
+{
+    stop_decoder();
+    logger->debug("Dropped {} late frames", dropped.load());
+}
+
+void VideoImage::stop_decoder()
+{
+    {
+        const std::scoped_lock lock{queue_mutex};
+        stop = true;
+    }
+    queue_cv.notify_all();
+    if (decoder.joinable()) {
+        decoder.join();
+    }
+}
+
+auto VideoImage::filename() const -> std::string
+{
+    return path.string();
+}
+
+auto VideoImage::dimensions() const -> const Dimensions &
+{
+    return *dims;
+}
+
+auto VideoImage::width() const -> int
+{
+    return current.cols;
+}
+
+auto VideoImage::height() const -> int
+{
+    return current.rows;
+}
+
+auto VideoImage::size() const -> size_t
+{
+    return current.total() * current.elemSize();
+}
+
+auto VideoImage::data() const -> const unsigned char *
+{
+    return current.data;
+}
+
+auto VideoImage::channels() const -> int
+{
+    return current.channels();
+}
+
+auto VideoImage::damage() const -> std::vector<damage::Rect>
+{
+    return current_damage;
+}
+
+auto VideoImage::is_animated() const -> bool
+{
+    return true;
+}
+
+void VideoImage::next_frame()
+{
+    resume_clock();
+    std::unique_lock lock{queue_mutex};
+    // only the first frame is waited for, later ones are skipped if the
+    // decoder falls behind
+    if (current.empty()) {
+        queue_cv.wait(lock, [this] { return !queue.empty() || finished; });
+    }
+    if (queue.empty()) {
+        // keep showing the last frame
+        current_damage.clear();
+        return;
+    }
+
+    // skip queued frames that should already have been replaced
+    const double now = clock();
+    bool skipped = false;
+    while (queue.size() > 1 && queue.at(1).pts <= now) {
+        queue.pop_front();
+        dropped += 1;
+        skipped = true;
+    }
+    auto &frame = queue.front();
+    previous = std::move(current);
+    current = std::move(frame.mat);
+    current_pts = frame.pts;
+    // the damage of a skipped frame is lost with it
+    if (skipped || previous.empty()) {
+        current_damage = damage::full(current.cols, current.rows);
+    } else {
+        current_damage = std::move(frame.damage);
+    }
+    queue.pop_front();
+    lock.unlock();
+    queue_cv.notify_all();
+}
+
+// the scheduler adds delays up, rounding both ends keeps them from drifting
+auto VideoImage::frame_delay() const -> int
+{
+    const double ms_per_sec = 1000;
+    const auto next_pts = current_pts + frame_duration;
+    return static_cast<int>(std::lround(next_pts * ms_per_sec) - std::lround(current_pts * ms_per_sec));
+}
+
+// hidden previews stop being advanced, playback continues where it stopped
+// instead of catching up with the time spent hidden
+void VideoImage::resume_clock()
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    const auto now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    const auto last = std::exchange(last_advance_ns, now_ns);
+    const auto start = start_ns.load();
+    if (start == 0 || last == 0) {
+        return;
+    }
+    const double ns_per_sec = 1e9;
+    const auto frame_ns = static_cast<int64_t>(frame_duration * ns_per_sec);
+    const auto threshold = std::max(static_cast<int64_t>(ns_per_sec), 2 * frame_ns);
+    const auto gap = now_ns - last;
+    if (gap > threshold) {
+        start_ns.store(start + gap - frame_ns);
+    }
+}
+
+auto VideoImage::clock() const -> double
+{
+    const auto start = start_ns.load();
+    if (start == 0) {
+        return 0;
+    }
+    const auto now = std::chrono::steady_clock::now().time_since_epoch() - std::chrono::nanoseconds(start);
+    return std::chrono::duration<double>(now).count();
+}
+
+void VideoImage::decode_loop()
+{
+    uint64_t index = 0;
+    uint64_t loop_start = 0;
+    uint64_t late = 0;
+    cv::Mat frame;
+    // queued frames are never written to, so sharing it is fine
+    cv::Mat last;
+    while (true) {
+        {
+            std::unique_lock lock{queue_mutex};
+            queue_cv.wait(lock, [this] { return stop || queue.size() < max_queued; });
+            if (stop) {
+                return;
+            }
+        }
+
+        if (!video.grab()) {
+            // start over like animated images do, unless nothing could be read
+            if (index == loop_start || !video.set(cv::CAP_PROP_POS_FRAMES, 0)) {
+                {
+                    const std::scoped_lock lock{queue_mutex};
+                    finished = true;
+                }
+                queue_cv.notify_all();
+                return;
+            }
+            loop_start = index;
+            continue;
+        }
+        const double pts = static_cast<double>(index) * frame_duration;
+        index += 1;
+
+        // late frames are only grabbed, which skips the colour conversion and
+        // the resize. still deliver one every second so slow files play
+        const auto frames_per_sec = static_cast<uint64_t>(1.0 / frame_duration);
+        if (pts + frame_duration < clock() && late < frames_per_sec) {
+            late += 1;
+            dropped += 1;
+            continue;
+        }
+        late = 0;
+        if (!video.retrieve(frame) || frame.empty()) {
+            continue;
+        }
+
+        auto mat = convert(frame);
+        auto rects = last.empty() ? damage::full(mat.cols, mat.rows)
+                                  : damage::diff(last.data, mat.data, mat.cols, mat.rows, mat.channels());
+        last = mat;
+        {
+            const std::scoped_lock lock{queue_mutex};
+            queue.push_back({std::move(mat), pts, std::move(rects)});
+        }
+        queue_cv.notify_all();
+    }
+}
+
+auto VideoImage::convert(const cv::Mat &frame) const -> cv::Mat
+{
+    cv::Mat mat;
+    if (frame.cols != target_width || frame.rows != target_height) {
+        cv::resize(frame, mat, cv::Size(target_width, target_height), 0, 0, cv::INTER_AREA);
+    } else {
+        // retrieve reuses its buffer
+        mat = frame.clone();
+    }
+
+#ifdef ENABLE_OPENGL
+    if (flags->use_opengl) {
+        cv::flip(mat, mat, 0);
+    }
+#endif
+
+    const std::unordered_set<std::string_view> bgra_trifecta = {"x11", "chafa", "wayland"};
+    if (bgra_trifecta.contains(flags->output)) {
+        cv::cvtColor(mat, mat, cv::COLOR_BGR2BGRA);
+    } else if (flags->output == "kitty" || flags->output == "sixel") {
+        cv::cvtColor(mat, mat, cv::COLOR_BGR2RGB);
+    }
+    return mat;
+}
@@ -0,0 +1,111 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef VIDEO_IMAGE_H
+#define VIDEO_IMAGE_H
+
+#include "image.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+#include <spdlog/spdlog.h>
+
+// Plays video files through cv::VideoCapture. Frames are resized and
+// converted on a separate thread, a few frames ahead of the one being
+// displayed. Frames that are already late are skipped to keep up with the
+// wall clock.
+class VideoImage : public Image
+{
+  public:
+    VideoImage(std::shared_ptr<Dimensions> new_dims, const std::string &filename);
+    ~VideoImage() override;
+
+    VideoImage(const VideoImage &) = delete;
+    auto operator=(const VideoImage &) -> VideoImage & = delete;
+
+    // known video extension or container signature, other files never get
+    // a decoder thread
+    [[nodiscard]] static auto is_video(const std::string &filename) -> bool;
+
+    [[nodiscard]] auto dimensions() const -> const Dimensions & override;
+    [[nodiscard]] auto width() const -> int override;
+    [[nodiscard]] auto height() const -> int override;
+    [[nodiscard]] auto size() const -> size_t override;
+    [[nodiscard]] auto data() const -> const unsigned char * override;
+    [[nodiscard]] auto channels() const -> int override;
+    [[nodiscard]] auto damage() const -> std::vector<damage::Rect> override;
+
+    void next_frame() override;
+    [[nodiscard]] auto frame_delay() const -> int override;
+    [[nodiscard]] auto is_animated() const -> bool override;
+    [[nodiscard]] auto filename() const -> std::string override;
+
+  private:
+    struct VideoFrame {
+        cv::Mat mat;
+        double pts;
+        // compared to the frame queued before it
+        std::vector<damage::Rect> damage;
+    };
+
+    static constexpr size_t max_queued = 4;
+
+    cv::VideoCapture video;
+    std::filesystem::path path;
+    std::shared_ptr<Dimensions> dims;
+    std::shared_ptr<Flags> flags;
+    std::shared_ptr<spdlog::logger> logger;
+
+    double frame_duration = 0;
+    int target_width = 0;
+    int target_height = 0;
+
+    // the previous frame may still be read by a late expose
+    cv::Mat current;
+    cv::Mat previous;
+    double current_pts = 0;
+    std::vector<damage::Rect> current_damage;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::deque<VideoFrame> queue;
+    bool finished = false;
+    bool stop = false;
+
+    std::atomic<int64_t> start_ns = 0;
+    int64_t last_advance_ns = 0;
+    std::atomic<uint64_t> dropped = 0;
+    std::thread decoder;
+
+    void decode_loop();
+    void stop_decoder();
+    void resume_clock();
+    [[nodiscard]] auto convert(const cv::Mat &frame) const -> cv::Mat;
+    [[nodiscard]] auto clock() const -> double;
+};
+
+#endif
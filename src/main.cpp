@@ -101,6 +101,10 @@ auto main(int argc, char *argv[]) -> int
     cmd_comand->add_option("--max-width", flags->cmd_max_width, "Max width of preview");
     cmd_comand->add_option("--max-height", flags->cmd_max_height, "Max height of preview");
 
+    auto *cache_command = program.add_subcommand("cache", "Inspect the cache of resized images.");
+    cache_command->add_flag("--stats", flags->cache_stats, "Print the size of the cache.");
+    cache_command->add_flag("--prune", flags->cache_prune, "Evict old entries until the cache fits its size limit.");
+
     auto *tmux_command = program.add_subcommand("tmux", "Handle tmux hooks. Used internaly.");
     tmux_command->allow_extras();
 
@@ -119,7 +123,7 @@ auto main(int argc, char *argv[]) -> int
         return 0;
     }
 
-    if (!layer_command->parsed() && !tmux_command->parsed() && !cmd_comand->parsed()) {
+    if (!layer_command->parsed() && !tmux_command->parsed() && !cmd_comand->parsed() && !cache_command->parsed()) {
         program.exit(CLI::CallForHelp());
         return 1;
     }
@@ -141,5 +145,9 @@ auto main(int argc, char *argv[]) -> int
         util::send_command(*flags);
     }
 
+    if (cache_command->parsed()) {
+        Application::handle_cache_command();
+    }
+
     return 0;
 }
@@ -27,18 +27,24 @@
 #  include "canvas/wayland/config.hpp"
 #endif
 
+#include <array>
 #include <cmath>
+#include <filesystem>
 #include <iostream>
 #include <unordered_set>
 
 #include <fcntl.h>
+#include <fmt/format.h>
 #include <range/v3/all.hpp>
 #include <spdlog/spdlog.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <system_error>
 #include <unistd.h>
 
+namespace fs = std::filesystem;
+
 Terminal::Terminal()
     : terminal_pid(pid)
 {
@@ -220,11 +226,49 @@ void Terminal::check_kitty_support()
     if (resp.find("OK") != std::string::npos) {
         supports_kitty = true;
         logger->debug("kitty is supported");
+        check_kitty_mediums();
     } else {
         logger->debug("kitty is not supported");
     }
 }
 
+// shared memory and temporary files only work if the terminal can open them,
+// errors are suppressed when drawing so each medium is tried once here
+void Terminal::check_kitty_mediums()
+{
+    const int name_size = 16;
+    const std::array<unsigned char, 3> pixel = {};
+
+    const auto shm_name = fmt::format("/ueberzugpp-{}", util::generate_random_string(name_size));
+    const int shm_fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (shm_fd != -1) {
+        const bool written = write(shm_fd, pixel.data(), pixel.size()) == static_cast<ssize_t>(pixel.size());
+        close(shm_fd);
+        flags->kitty_shm = written && query_kitty_medium("s", shm_name);
+        // the terminal unlinks it after reading, unless it never did
+        shm_unlink(shm_name.c_str());
+    }
+
+    const auto file_path = fs::temp_directory_path() / fmt::format("ueberzugpp-tty-graphics-protocol-{}",
+                                                                   util::generate_random_string(name_size));
+    const int file_fd = open(file_path.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0600);
+    if (file_fd != -1) {
+        const bool written = write(file_fd, pixel.data(), pixel.size()) == static_cast<ssize_t>(pixel.size());
+        close(file_fd);
+        flags->kitty_file = written && query_kitty_medium("t", file_path.native());
+        std::error_code err;
+        fs::remove(file_path, err);
+    }
+    logger->debug("kitty shared memory: {}, temporary files: {}", flags->kitty_shm, flags->kitty_file);
+}
+
+auto Terminal::query_kitty_medium(std::string_view medium, std::string_view name) -> bool
+{
+    const auto payload = util::base64_encode(reinterpret_cast<const unsigned char *>(name.data()), name.size());
+    const auto resp = read_raw_str(fmt::format("\033_Gi=31,s=1,v=1,a=q,t={},f=24;{}\033\\\033[c", medium, payload));
+    return resp.find("OK") != std::string::npos;
+}
+
 void Terminal::check_iterm2_support()
 {
     const auto supported_terms = std::unordered_set<std::string_view>{"WezTerm", "iTerm.app"};
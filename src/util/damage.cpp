@@ -0,0 +1,109 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "util/damage.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+
+constexpr int tile_size = 32;
+// past this amount of rects a single bounding box is cheaper to upload
+constexpr size_t max_rects = 32;
+
+auto tile_changed(const unsigned char *prev, const unsigned char *cur, size_t stride, size_t offset, size_t length,
+                  int rows) -> bool
+{
+    for (int row = 0; row < rows; ++row) {
+        const size_t start = (row * stride) + offset;
+        if (std::memcmp(prev + start, cur + start, length) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+auto bounding_box(const std::vector<damage::Rect> &rects) -> damage::Rect
+{
+    damage::Rect box = rects.front();
+    int right = box.x + box.width;
+    int bottom = box.y + box.height;
+    for (const auto &rect : rects) {
+        box.x = std::min(box.x, rect.x);
+        box.y = std::min(box.y, rect.y);
+        right = std::max(right, rect.x + rect.width);
+        bottom = std::max(bottom, rect.y + rect.height);
+    }
+    box.width = right - box.x;
+    box.height = bottom - box.y;
+    return box;
+}
+
+} // namespace
+
+auto damage::full(int width, int height) -> std::vector<Rect>
+{
+    return {{0, 0, width, height}};
+}
+
+auto damage::diff(const unsigned char *prev, const unsigned char *cur, int width, int height, int channels)
+    -> std::vector<Rect>
+{
+    std::vector<Rect> rects;
+    std::vector<Rect> spans;
+    const size_t stride = static_cast<size_t>(width) * channels;
+    for (int tile_y = 0; tile_y < height; tile_y += tile_size) {
+        const int rows = std::min(tile_size, height - tile_y);
+        const unsigned char *prev_rows = prev + (tile_y * stride);
+        const unsigned char *cur_rows = cur + (tile_y * stride);
+
+        // consecutive changed tiles of this row become a single span
+        spans.clear();
+        for (int tile_x = 0; tile_x < width; tile_x += tile_size) {
+            const int columns = std::min(tile_size, width - tile_x);
+            const size_t offset = static_cast<size_t>(tile_x) * channels;
+            const size_t length = static_cast<size_t>(columns) * channels;
+            if (!tile_changed(prev_rows, cur_rows, stride, offset, length, rows)) {
+                continue;
+            }
+            if (!spans.empty() && spans.back().x + spans.back().width == tile_x) {
+                spans.back().width += columns;
+            } else {
+                spans.push_back({tile_x, tile_y, columns, rows});
+            }
+        }
+
+        // spans right below a rect of the same width extend it
+        for (const auto &span : spans) {
+            const auto above = std::find_if(rects.begin(), rects.end(), [&span](const Rect &rect) {
+                return rect.x == span.x && rect.width == span.width && rect.y + rect.height == span.y;
+            });
+            if (above != rects.end()) {
+                above->height += span.height;
+            } else {
+                rects.push_back(span);
+            }
+        }
+    }
+
+    if (rects.size() > max_rects) {
+        return {bounding_box(rects)};
+    }
+    return rects;
+}
@@ -0,0 +1,368 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "util/pixels.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define PIXELS_X86
+#  include <immintrin.h>
+#elif defined(__ARM_NEON)
+#  define PIXELS_NEON
+#  include <arm_neon.h>
+#endif
+
+namespace
+{
+
+struct Order {
+    int red;
+    int green;
+    int blue;
+    int alpha;
+    int channels;
+};
+
+constexpr auto order(pixels::Layout layout) -> Order
+{
+    using enum pixels::Layout;
+    switch (layout) {
+        case gray:
+            return {0, 0, 0, -1, 1};
+        case rgb:
+            return {0, 1, 2, -1, 3};
+        case bgr:
+            return {2, 1, 0, -1, 3};
+        case rgba:
+            return {0, 1, 2, 3, 4};
+        case bgra:
+            return {2, 1, 0, 3, 4};
+    }
+    return {0, 1, 2, -1, 3};
+}
+
+// exact x / 255 for x <= 255 * 255
+constexpr auto div255(uint32_t value) -> uint32_t
+{
+    return (value + 1 + (value >> 8)) >> 8;
+}
+
+constexpr auto reduce(uint8_t value) -> uint32_t
+{
+    return value;
+}
+
+constexpr auto reduce(uint16_t value) -> uint32_t
+{
+    return std::min<uint32_t>((value + 128) >> 8, 255);
+}
+
+template <typename T>
+void convert_scalar(const T *src, Order from, unsigned char *dst, Order to, size_t count, bool premultiply)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const T *in = src + (i * from.channels);
+        unsigned char *out = dst + (i * to.channels);
+        uint32_t red = reduce(in[from.red]);
+        uint32_t green = reduce(in[from.green]);
+        uint32_t blue = reduce(in[from.blue]);
+        const uint32_t alpha = from.alpha >= 0 ? reduce(in[from.alpha]) : 255;
+        if (premultiply) {
+            red = div255(red * alpha);
+            green = div255(green * alpha);
+            blue = div255(blue * alpha);
+        }
+        out[to.red] = static_cast<unsigned char>(red);
+        out[to.green] = static_cast<unsigned char>(green);
+        out[to.blue] = static_cast<unsigned char>(blue);
+        if (to.alpha >= 0) {
+            out[to.alpha] = static_cast<unsigned char>(alpha);
+        }
+    }
+}
+
+// the vector kernels below handle as many pixels as they can and return how
+// many they converted, the scalar loop takes care of the rest
+using kernel_t = size_t (*)(const unsigned char *src, unsigned char *dst, size_t count, bool swap, bool premultiply);
+
+auto kernel_none(const unsigned char * /*src*/, unsigned char * /*dst*/, size_t /*count*/, bool /*swap*/,
+                 bool /*premultiply*/) -> size_t
+{
+    return 0;
+}
+
+#ifdef PIXELS_X86
+
+__attribute__((target("ssse3"))) inline auto mul_div255_sse(__m128i color, __m128i alpha) -> __m128i
+{
+    const __m128i value = _mm_mullo_epi16(color, alpha);
+    const __m128i sum = _mm_add_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), _mm_set1_epi16(1));
+    return _mm_srli_epi16(sum, 8);
+}
+
+__attribute__((target("ssse3"))) inline auto premultiply_sse(__m128i pixels) -> __m128i
+{
+    const __m128i alpha_mask = _mm_setr_epi8(3, 3, 3, -1, 7, 7, 7, -1, 11, 11, 11, -1, 15, 15, 15, -1);
+    const __m128i alpha_one = _mm_setr_epi8(0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_or_si128(_mm_shuffle_epi8(pixels, alpha_mask), alpha_one);
+    const __m128i low = mul_div255_sse(_mm_unpacklo_epi8(pixels, zero), _mm_unpacklo_epi8(alpha, zero));
+    const __m128i high = mul_div255_sse(_mm_unpackhi_epi8(pixels, zero), _mm_unpackhi_epi8(alpha, zero));
+    return _mm_packus_epi16(low, high);
+}
+
+__attribute__((target("ssse3"))) auto rgba_to_rgba_ssse3(const unsigned char *src, unsigned char *dst, size_t count,
+                                                         bool swap, bool premultiply) -> size_t
+{
+    const __m128i swizzle = swap ? _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15)
+                                 : _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (i * 4)));
+        pixels = _mm_shuffle_epi8(pixels, swizzle);
+        if (premultiply) {
+            pixels = premultiply_sse(pixels);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + (i * 4)), pixels);
+    }
+    return i;
+}
+
+__attribute__((target("ssse3"))) auto rgb_to_rgba_ssse3(const unsigned char *src, unsigned char *dst, size_t count,
+                                                        bool swap, bool /*premultiply*/) -> size_t
+{
+    const __m128i swizzle = swap ? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+                                 : _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha_one = _mm_setr_epi8(0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1);
+    size_t i = 0;
+    // 16 bytes are read for every 4 pixels
+    for (; i + 6 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (i * 3)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + (i * 4)),
+                         _mm_or_si128(_mm_shuffle_epi8(pixels, swizzle), alpha_one));
+    }
+    return i;
+}
+
+__attribute__((target("ssse3"))) auto rgba_to_rgb_ssse3(const unsigned char *src, unsigned char *dst, size_t count,
+                                                        bool swap, bool premultiply) -> size_t
+{
+    const __m128i swizzle = swap ? _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15)
+                                 : _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    size_t i = 0;
+    // 16 bytes are written for every 4 pixels, the last 4 get overwritten
+    for (; i + 6 <= count; i += 4) {
+        __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (i * 4)));
+        pixels = _mm_shuffle_epi8(pixels, swizzle);
+        if (premultiply) {
+            pixels = premultiply_sse(pixels);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + (i * 3)), _mm_shuffle_epi8(pixels, pack));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) inline auto mul_div255_avx2(__m256i color, __m256i alpha) -> __m256i
+{
+    const __m256i value = _mm256_mullo_epi16(color, alpha);
+    const __m256i sum = _mm256_add_epi16(_mm256_add_epi16(value, _mm256_srli_epi16(value, 8)), _mm256_set1_epi16(1));
+    return _mm256_srli_epi16(sum, 8);
+}
+
+__attribute__((target("avx2"))) auto rgba_to_rgba_avx2(const unsigned char *src, unsigned char *dst, size_t count,
+                                                       bool swap, bool premultiply) -> size_t
+{
+    const __m256i swizzle =
+        swap ? _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8,
+                                11, 14, 13, 12, 15)
+             : _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                11, 12, 13, 14, 15);
+    const __m256i alpha_mask = _mm256_setr_epi8(3, 3, 3, -1, 7, 7, 7, -1, 11, 11, 11, -1, 15, 15, 15, -1, 3, 3, 3, -1,
+                                                7, 7, 7, -1, 11, 11, 11, -1, 15, 15, 15, -1);
+    const __m256i alpha_one = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + (i * 4)));
+        pixels = _mm256_shuffle_epi8(pixels, swizzle);
+        if (premultiply) {
+            const __m256i alpha = _mm256_or_si256(_mm256_shuffle_epi8(pixels, alpha_mask), alpha_one);
+            const __m256i low =
+                mul_div255_avx2(_mm256_unpacklo_epi8(pixels, zero), _mm256_unpacklo_epi8(alpha, zero));
+            const __m256i high =
+                mul_div255_avx2(_mm256_unpackhi_epi8(pixels, zero), _mm256_unpackhi_epi8(alpha, zero));
+            pixels = _mm256_packus_epi16(low, high);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + (i * 4)), pixels);
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) auto rgb_to_rgba_avx2(const unsigned char *src, unsigned char *dst, size_t count,
+                                                      bool swap, bool /*premultiply*/) -> size_t
+{
+    const __m256i swizzle =
+        swap ? _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6,
+                                -1, 11, 10, 9, -1)
+             : _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8,
+                                -1, 9, 10, 11, -1);
+    const __m256i alpha_one = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+    size_t i = 0;
+    // two overlapping 16 byte loads for every 8 pixels
+    for (; i + 10 <= count; i += 8) {
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (i * 3)));
+        const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + (i * 3) + 12));
+        const __m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + (i * 4)),
+                            _mm256_or_si256(_mm256_shuffle_epi8(pixels, swizzle), alpha_one));
+    }
+    return i;
+}
+
+#endif // PIXELS_X86
+
+#ifdef PIXELS_NEON
+
+inline auto mul_div255_neon(uint8x16_t color, uint8x16_t alpha) -> uint8x16_t
+{
+    uint16x8_t low = vmull_u8(vget_low_u8(color), vget_low_u8(alpha));
+    uint16x8_t high = vmull_u8(vget_high_u8(color), vget_high_u8(alpha));
+    low = vaddq_u16(vaddq_u16(low, vshrq_n_u16(low, 8)), vdupq_n_u16(1));
+    high = vaddq_u16(vaddq_u16(high, vshrq_n_u16(high, 8)), vdupq_n_u16(1));
+    return vcombine_u8(vshrn_n_u16(low, 8), vshrn_n_u16(high, 8));
+}
+
+auto rgba_to_rgba_neon(const unsigned char *src, unsigned char *dst, size_t count, bool swap, bool premultiply)
+    -> size_t
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        uint8x16x4_t pixels = vld4q_u8(src + (i * 4));
+        if (swap) {
+            std::swap(pixels.val[0], pixels.val[2]);
+        }
+        if (premultiply) {
+            pixels.val[0] = mul_div255_neon(pixels.val[0], pixels.val[3]);
+            pixels.val[1] = mul_div255_neon(pixels.val[1], pixels.val[3]);
+            pixels.val[2] = mul_div255_neon(pixels.val[2], pixels.val[3]);
+        }
+        vst4q_u8(dst + (i * 4), pixels);
+    }
+    return i;
+}
+
+auto rgb_to_rgba_neon(const unsigned char *src, unsigned char *dst, size_t count, bool swap, bool /*premultiply*/)
+    -> size_t
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16x3_t pixels = vld3q_u8(src + (i * 3));
+        uint8x16x4_t out;
+        out.val[0] = swap ? pixels.val[2] : pixels.val[0];
+        out.val[1] = pixels.val[1];
+        out.val[2] = swap ? pixels.val[0] : pixels.val[2];
+        out.val[3] = vdupq_n_u8(255);
+        vst4q_u8(dst + (i * 4), out);
+    }
+    return i;
+}
+
+auto rgba_to_rgb_neon(const unsigned char *src, unsigned char *dst, size_t count, bool swap, bool premultiply)
+    -> size_t
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16x4_t pixels = vld4q_u8(src + (i * 4));
+        uint8x16x3_t out;
+        out.val[0] = swap ? pixels.val[2] : pixels.val[0];
+        out.val[1] = pixels.val[1];
+        out.val[2] = swap ? pixels.val[0] : pixels.val[2];
+        if (premultiply) {
+            out.val[0] = mul_div255_neon(out.val[0], pixels.val[3]);
+            out.val[1] = mul_div255_neon(out.val[1], pixels.val[3]);
+            out.val[2] = mul_div255_neon(out.val[2], pixels.val[3]);
+        }
+        vst3q_u8(dst + (i * 3), out);
+    }
+    return i;
+}
+
+#endif // PIXELS_NEON
+
+struct Kernels {
+    kernel_t rgba_to_rgba = kernel_none;
+    kernel_t rgb_to_rgba = kernel_none;
+    kernel_t rgba_to_rgb = kernel_none;
+};
+
+auto select_kernels() -> Kernels
+{
+    Kernels kernels;
+#ifdef PIXELS_X86
+    if (__builtin_cpu_supports("ssse3")) {
+        kernels = {rgba_to_rgba_ssse3, rgb_to_rgba_ssse3, rgba_to_rgb_ssse3};
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.rgba_to_rgba = rgba_to_rgba_avx2;
+        kernels.rgb_to_rgba = rgb_to_rgba_avx2;
+    }
+#elif defined(PIXELS_NEON)
+    kernels = {rgba_to_rgba_neon, rgb_to_rgba_neon, rgba_to_rgb_neon};
+#endif
+    return kernels;
+}
+
+auto kernels() -> const Kernels &
+{
+    static const Kernels kernels = select_kernels();
+    return kernels;
+}
+
+} // namespace
+
+auto pixels::channels(Layout layout) -> int
+{
+    return order(layout).channels;
+}
+
+void pixels::convert(const unsigned char *src, Layout from, unsigned char *dst, Layout to, size_t count,
+                     bool premultiply)
+{
+    const auto src_order = order(from);
+    const auto dst_order = order(to);
+    premultiply = premultiply && src_order.alpha >= 0;
+    const bool swap = src_order.red != dst_order.red;
+
+    size_t done = 0;
+    if (src_order.channels == 4 && dst_order.channels == 4) {
+        done = kernels().rgba_to_rgba(src, dst, count, swap, premultiply);
+    } else if (src_order.channels == 3 && dst_order.channels == 4) {
+        done = kernels().rgb_to_rgba(src, dst, count, swap, premultiply);
+    } else if (src_order.channels == 4 && dst_order.channels == 3) {
+        done = kernels().rgba_to_rgb(src, dst, count, swap, premultiply);
+    }
+    convert_scalar(src + (done * src_order.channels), src_order, dst + (done * dst_order.channels), dst_order,
+                   count - done, premultiply);
+}
+
+void pixels::convert(const uint16_t *src, Layout from, unsigned char *dst, Layout to, size_t count, bool premultiply)
+{
+    const auto src_order = order(from);
+    convert_scalar(src, src_order, dst, order(to), count, premultiply && src_order.alpha >= 0);
+}
@@ -0,0 +1,212 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "util/scheduler.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+// past this many, the animation starts over from the current time
+constexpr int max_skipped = 32;
+
+AnimationScheduler::AnimationScheduler()
+{
+    worker = std::thread([this] { run(); });
+}
+
+AnimationScheduler::~AnimationScheduler()
+{
+    {
+        const std::scoped_lock lock{scheduler_mutex};
+        stop = true;
+    }
+    scheduler_cv.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+auto AnimationScheduler::add(int delay, step_t step) -> Handle
+{
+    uint64_t id = 0;
+    {
+        const std::scoped_lock lock{scheduler_mutex};
+        id = next_id;
+        next_id += 1;
+        animations.emplace(id, Animation{std::make_shared<step_t>(std::move(step))});
+        deadlines.push({clock::now() + std::chrono::milliseconds(std::max(delay, 0)), id, 0});
+    }
+    scheduler_cv.notify_all();
+    return {instance(), id};
+}
+
+void AnimationScheduler::remove(uint64_t id)
+{
+    std::unique_lock lock{scheduler_mutex};
+    animations.erase(id);
+    // a step may stop its own animation
+    if (std::this_thread::get_id() != worker.get_id()) {
+        scheduler_cv.wait(lock, [this, id] { return running != id; });
+    }
+}
+
+void AnimationScheduler::pause(uint64_t id)
+{
+    std::unique_lock lock{scheduler_mutex};
+    const auto entry = animations.find(id);
+    if (entry == animations.end() || entry->second.paused) {
+        return;
+    }
+    entry->second.paused = true;
+    entry->second.generation += 1;
+    if (std::this_thread::get_id() != worker.get_id()) {
+        scheduler_cv.wait(lock, [this, id] { return running != id; });
+    }
+}
+
+void AnimationScheduler::resume(uint64_t id)
+{
+    {
+        const std::scoped_lock lock{scheduler_mutex};
+        const auto entry = animations.find(id);
+        if (entry == animations.end() || !entry->second.paused) {
+            return;
+        }
+        entry->second.paused = false;
+        deadlines.push({clock::now(), id, entry->second.generation});
+    }
+    scheduler_cv.notify_all();
+}
+
+void AnimationScheduler::run()
+{
+    std::unique_lock lock{scheduler_mutex};
+    while (!stop) {
+        if (deadlines.empty()) {
+            scheduler_cv.wait(lock);
+            continue;
+        }
+        const auto next = deadlines.top();
+        const auto entry = animations.find(next.id);
+        if (entry == animations.end() || entry->second.generation != next.generation) {
+            deadlines.pop();
+            continue;
+        }
+        if (clock::now() < next.due) {
+            scheduler_cv.wait_until(lock, next.due);
+            continue;
+        }
+        deadlines.pop();
+        running = next.id;
+        const auto step = entry->second.step;
+        lock.unlock();
+
+        auto due = next.due;
+        int delay = -1;
+        try {
+            delay = (*step)(true);
+            // frames that should already have been replaced are never drawn
+            const auto now = clock::now();
+            int skipped = 0;
+            while (delay >= 0) {
+                due += std::chrono::milliseconds(delay);
+                if (due >= now) {
+                    break;
+                }
+                if (skipped == max_skipped) {
+                    due = now;
+                    break;
+                }
+                delay = (*step)(false);
+                skipped += 1;
+            }
+        } catch (const std::exception &ex) {
+            // a failing animation is dropped, the others keep playing
+            if (const auto logger = spdlog::get("main")) {
+                logger->error("stopping animation: {}", ex.what());
+            }
+            delay = -1;
+        }
+
+        lock.lock();
+        running = 0;
+        const auto current = animations.find(next.id);
+        if (current != animations.end() && delay < 0) {
+            animations.erase(current);
+        } else if (current != animations.end() && current->second.generation == next.generation) {
+            deadlines.push({due, next.id, next.generation});
+        }
+        scheduler_cv.notify_all();
+    }
+}
+
+AnimationScheduler::Handle::Handle(std::shared_ptr<AnimationScheduler> scheduler, uint64_t id)
+    : scheduler(std::move(scheduler)),
+      id(id)
+{
+}
+
+AnimationScheduler::Handle::~Handle()
+{
+    reset();
+}
+
+AnimationScheduler::Handle::Handle(Handle &&other) noexcept
+    : scheduler(std::move(other.scheduler)),
+      id(std::exchange(other.id, 0))
+{
+}
+
+auto AnimationScheduler::Handle::operator=(Handle &&other) noexcept -> Handle &
+{
+    if (this != &other) {
+        reset();
+        scheduler = std::move(other.scheduler);
+        id = std::exchange(other.id, 0);
+    }
+    return *this;
+}
+
+void AnimationScheduler::Handle::reset()
+{
+    if (scheduler && id != 0) {
+        scheduler->remove(id);
+    }
+    scheduler.reset();
+    id = 0;
+}
+
+void AnimationScheduler::Handle::pause() const
+{
+    if (scheduler && id != 0) {
+        scheduler->pause(id);
+    }
+}
+
+void AnimationScheduler::Handle::resume() const
+{
+    if (scheduler && id != 0) {
+        scheduler->resume(id);
+    }
+}
+
+AnimationScheduler::Handle::operator bool() const
+{
+    return id != 0;
+}
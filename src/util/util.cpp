@@ -164,11 +164,6 @@ void util::restore_cursor_position()
     std::cout << "\0338" << std::flush;
 }
 
-auto util::get_cache_file_save_location(const fs::path &path) -> std::string
-{
-    return fmt::format("{}{}{}", get_cache_path(), get_b2_hash_ssl(path.string()), path.extension().string());
-}
-
 void util::benchmark(const std::function<void(void)> &func)
 {
     using std::chrono::duration;
@@ -0,0 +1,105 @@
+// Display images inside a terminal
+// Copyright (C) 2023  JustKidding
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "util/zlib.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#ifdef HAVE_STD_EXECUTION_H
+#  include <execution>
+#else
+#  include <oneapi/tbb.h>
+#endif
+
+namespace
+{
+
+// big enough to keep the ratio close to a single stream, small enough to
+// keep every core busy on a preview sized image
+constexpr size_t block_size = 256 * 1024;
+constexpr int window_bits = 15;
+constexpr int mem_level = 8;
+// space for the empty stored block a sync flush ends with
+constexpr size_t flush_margin = 16;
+
+struct Block {
+    const unsigned char *input;
+    size_t size;
+    bool last;
+    std::vector<unsigned char> output;
+    uLong adler;
+};
+
+void compress_block(Block &block)
+{
+    z_stream stream{};
+    // negative window bits produce raw deflate data, the zlib wrapper is
+    // written once for all blocks
+    if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, -window_bits, mem_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("could not initialize deflate");
+    }
+    block.output.resize(deflateBound(&stream, block.size) + flush_margin);
+    stream.next_in = const_cast<unsigned char *>(block.input);
+    stream.avail_in = static_cast<uInt>(block.size);
+    stream.next_out = block.output.data();
+    stream.avail_out = static_cast<uInt>(block.output.size());
+    const int res = deflate(&stream, block.last ? Z_FINISH : Z_SYNC_FLUSH);
+    const bool done = block.last ? res == Z_STREAM_END : res == Z_OK && stream.avail_in == 0;
+    block.output.resize(stream.total_out);
+    deflateEnd(&stream);
+    if (!done) {
+        throw std::runtime_error("could not deflate block");
+    }
+    block.adler = adler32(adler32(0, nullptr, 0), block.input, static_cast<uInt>(block.size));
+}
+
+} // namespace
+
+auto zlib::compress(const unsigned char *data, size_t size) -> std::vector<unsigned char>
+{
+    const auto num_blocks = std::max<size_t>((size + block_size - 1) / block_size, 1);
+    std::vector<Block> blocks(num_blocks);
+    for (size_t idx = 0; idx < num_blocks; ++idx) {
+        const auto offset = idx * block_size;
+        blocks.at(idx) = {data + offset, std::min(block_size, size - offset), idx + 1 == num_blocks, {}, 0};
+    }
+
+#ifdef HAVE_STD_EXECUTION_H
+    std::for_each(std::execution::par_unseq, std::begin(blocks), std::end(blocks), compress_block);
+#else
+    oneapi::tbb::parallel_for_each(std::begin(blocks), std::end(blocks), compress_block);
+#endif
+
+    const auto total = std::accumulate(std::begin(blocks), std::end(blocks), size_t{0},
+                                       [](size_t sum, const Block &block) { return sum + block.output.size(); });
+    // deflate with a 32K window, fastest compression level
+    std::vector<unsigned char> result{0x78, 0x01};
+    result.reserve(total + 6);
+    uLong adler = adler32(0, nullptr, 0);
+    for (const auto &block : blocks) {
+        result.insert(std::end(result), std::begin(block.output), std::end(block.output));
+        adler = adler32_combine(adler, block.adler, static_cast<z_off_t>(block.size));
+    }
+    const int byte_bits = 8;
+    for (int shift = 3 * byte_bits; shift >= 0; shift -= byte_bits) {
+        result.push_back(static_cast<unsigned char>((adler >> shift) & 0xFF));
+    }
+    return result;
+}